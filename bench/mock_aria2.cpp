@@ -0,0 +1,382 @@
+#include "mock_aria2.hpp"
+#include <algorithm>
+#include <charconv>
+#include <cctype>
+#include <cerrno>
+#include <format>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using json = nlohmann::json;
+
+namespace {
+
+// JSON-RPC error raised by a method, turned into an "error" member (or a multicall fault)
+struct Fault {
+  int code;
+  std::string message;
+};
+
+json fault_object(const Fault& fault) {
+  return {{"code", fault.code}, {"message", fault.message}};
+}
+
+bool send_all(int fd, std::string_view data) {
+  while (!data.empty()) {
+    auto sent = send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+    if (sent < 0 && errno == EINTR) {
+      continue;
+    }
+    if (sent <= 0) {
+      return false;
+    }
+    data.remove_prefix(static_cast<size_t>(sent));
+  }
+  return true;
+}
+
+// Case-insensitive lookup of a header value in the raw request head
+std::optional<std::string_view> header_value(std::string_view head, std::string_view name) {
+  size_t line_start = head.find("\r\n");
+  while (line_start != std::string_view::npos && line_start + 2 < head.size()) {
+    line_start += 2;
+    auto line_end = head.find("\r\n", line_start);
+    auto line = head.substr(line_start, line_end == std::string_view::npos ? std::string_view::npos : line_end - line_start);
+    if (line.size() > name.size() && line[name.size()] == ':' &&
+        std::ranges::equal(line.substr(0, name.size()), name, [](char a, char b) { return std::tolower(a) == std::tolower(b); })) {
+      auto value = line.substr(name.size() + 1);
+      value.remove_prefix(std::min(value.find_first_not_of(' '), value.size()));
+      return value;
+    }
+    line_start = line_end;
+  }
+  return std::nullopt;
+}
+
+} // namespace
+
+bench::MockAria2::MockAria2(TransferProfile profile, std::string secret, std::uint32_t seed)
+    : profile(profile), token("token:" + std::move(secret)), random(seed) {
+  listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (listen_fd < 0) {
+    throw std::runtime_error("[mock] Could not create a socket");
+  }
+  int enable = 1;
+  setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = 0; // any free port
+  socklen_t length = sizeof(address);
+  if (bind(listen_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(listen_fd, SOMAXCONN) != 0 ||
+      getsockname(listen_fd, reinterpret_cast<sockaddr*>(&address), &length) != 0) {
+    close(listen_fd);
+    throw std::runtime_error("[mock] Could not listen on the loopback interface");
+  }
+  port = ntohs(address.sin_port);
+  server = std::thread([this] { serve(); });
+}
+
+bench::MockAria2::~MockAria2() {
+  stopping = true;
+  server.join();
+  close(listen_fd);
+}
+
+std::string bench::MockAria2::url() const {
+  return std::format("http://127.0.0.1:{}/jsonrpc", port);
+}
+
+void bench::MockAria2::set_profile(const TransferProfile& profile) {
+  std::lock_guard lock(mutex);
+  this->profile = profile;
+}
+
+size_t bench::MockAria2::notifications(std::string_view method) const {
+  std::lock_guard lock(mutex);
+  auto it = notification_counts.find(method);
+  return it != notification_counts.end() ? it->second : 0;
+}
+
+void bench::MockAria2::serve() {
+  struct Connection {
+    int fd;
+    std::string buffer;
+  };
+  std::vector<Connection> connections;
+  std::vector<pollfd> poll_fds;
+
+  while (!stopping) {
+    poll_fds.clear();
+    poll_fds.push_back({listen_fd, POLLIN, 0});
+    for (const auto& connection : connections) {
+      poll_fds.push_back({connection.fd, POLLIN, 0});
+    }
+    if (poll(poll_fds.data(), poll_fds.size(), 50) <= 0) {
+      continue;
+    }
+
+    if (poll_fds[0].revents & POLLIN) {
+      if (int fd = accept(listen_fd, nullptr, nullptr); fd >= 0) {
+        int enable = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+        connections.push_back({fd, {}});
+      }
+    }
+
+    // Only the connections polled this round; any accepted above wait for the next one
+    for (size_t i = 1; i < poll_fds.size(); ++i) {
+      if (poll_fds[i].revents == 0) {
+        continue;
+      }
+      auto& connection = connections[i - 1];
+      char chunk[16384];
+      auto received = recv(connection.fd, chunk, sizeof(chunk), 0);
+      bool keep_open = received > 0;
+      if (keep_open) {
+        connection.buffer.append(chunk, static_cast<size_t>(received));
+      }
+
+      // Answer every complete request in the buffer (clients may pipeline)
+      while (keep_open) {
+        auto head_end = connection.buffer.find("\r\n\r\n");
+        if (head_end == std::string::npos) {
+          break;
+        }
+        std::string_view head{connection.buffer.data(), head_end};
+        size_t content_length = 0;
+        if (auto value = header_value(head, "Content-Length")) {
+          std::from_chars(value->data(), value->data() + value->size(), content_length);
+        }
+        if (connection.buffer.size() < head_end + 4 + content_length) {
+          break;
+        }
+        bool close_after = header_value(head, "Connection").value_or("") == "close";
+        auto reply = handle_request(std::string_view{connection.buffer}.substr(head_end + 4, content_length));
+        connection.buffer.erase(0, head_end + 4 + content_length);
+        ++request_count;
+
+        auto response = std::format("HTTP/1.1 200 OK\r\nContent-Type: application/json-rpc\r\nContent-Length: {}\r\n{}\r\n{}", reply.size(),
+                                    close_after ? "Connection: close\r\n" : "", reply);
+        keep_open = send_all(connection.fd, response) && !close_after;
+      }
+      if (!keep_open) {
+        close(connection.fd);
+        connection.fd = -1;
+      }
+    }
+    std::erase_if(connections, [](const Connection& connection) { return connection.fd < 0; });
+  }
+
+  for (const auto& connection : connections) {
+    close(connection.fd);
+  }
+}
+
+std::string bench::MockAria2::handle_request(std::string_view body) {
+  json request;
+  try {
+    request = json::parse(body);
+  } catch (const json::parse_error&) {
+    return json{{"jsonrpc", "2.0"}, {"id", nullptr}, {"error", fault_object({-32700, "Parse error."})}}.dump();
+  }
+
+  json reply = {{"jsonrpc", "2.0"}, {"id", request.value("id", json{})}};
+  try {
+    reply["result"] = call(request.value("method", std::string{}), request.value("params", json::array()));
+  } catch (const Fault& fault) {
+    reply["error"] = fault_object(fault);
+  } catch (const json::exception& e) {
+    reply["error"] = fault_object({1, e.what()});
+  }
+  return reply.dump();
+}
+
+json bench::MockAria2::call(const std::string& method, json params) {
+  ++rpc_count;
+
+  if (method == "system.multicall") {
+    // Each call carries its own secret; results are [value] on success and a fault object otherwise
+    json results = json::array();
+    for (auto& entry : params.at(0)) {
+      try {
+        results.push_back(json::array({call(entry.at("methodName").get<std::string>(), entry.value("params", json::array()))}));
+      } catch (const Fault& fault) {
+        results.push_back(fault_object(fault));
+      }
+    }
+    return results;
+  }
+  if (method == "system.listMethods") {
+    return json::array({"aria2.addUri", "aria2.tellStatus", "aria2.remove", "aria2.forceRemove", "aria2.pause", "aria2.forcePause",
+                        "aria2.unpause", "aria2.pauseAll", "aria2.forcePauseAll", "aria2.unpauseAll", "aria2.removeDownloadResult",
+                        "aria2.changeOption", "aria2.changeGlobalOption", "aria2.getGlobalStat", "aria2.saveSession", "aria2.getVersion",
+                        "system.multicall"});
+  }
+
+  if (params.empty() || !params[0].is_string() || params[0].get<std::string>() != token) {
+    throw Fault{1, "Unauthorized"};
+  }
+  params.erase(params.begin());
+
+  std::lock_guard lock(mutex);
+  auto now = std::chrono::steady_clock::now();
+  auto find = [&](const json& gid) -> std::pair<const std::string, Transfer>& {
+    auto it = transfers.find(gid.get<std::string>());
+    if (it == transfers.end()) {
+      throw Fault{1, std::format("GID {} is not found", gid.get<std::string>())};
+    }
+    advance(it->second, now);
+    return *it;
+  };
+
+  if (method == "aria2.getVersion") {
+    return {{"version", "1.37.0-mock"}, {"enabledFeatures", json::array()}};
+  }
+  if (method == "aria2.getGlobalStat") {
+    std::uint64_t speed = 0;
+    size_t active = 0;
+    size_t waiting = 0;
+    for (auto& [gid, transfer] : transfers) {
+      advance(transfer, now);
+      if (transfer.status == "active") {
+        speed += transfer.speed;
+        ++active;
+      } else if (transfer.status == "paused") {
+        ++waiting;
+      }
+    }
+    return {{"downloadSpeed", std::to_string(speed)}, {"numActive", std::to_string(active)}, {"numWaiting", std::to_string(waiting)}};
+  }
+  if (method == "aria2.addUri") {
+    if (params.empty() || !params[0].is_array() || params[0].empty()) {
+      throw Fault{1, "No URI to download."};
+    }
+    auto gid = std::format("{:016x}", next_gid++);
+    Transfer transfer{.total_length = profile.total_length,
+                      .speed = profile.speed,
+                      .fail_at = std::nullopt,
+                      .error_code = profile.error_code,
+                      .last_update = now};
+    if (std::bernoulli_distribution(profile.failure_rate)(random)) {
+      transfer.fail_at = std::uniform_int_distribution<std::uint64_t>(0, profile.total_length - 1)(random);
+    }
+    transfers.emplace(gid, transfer);
+    notify("aria2.onDownloadStart");
+    return gid;
+  }
+  if (method == "aria2.tellStatus") {
+    auto& [gid, transfer] = find(params.at(0));
+    return status_of(gid, transfer, params.size() > 1 ? params[1] : json::array());
+  }
+  if (method == "aria2.remove" || method == "aria2.forceRemove") {
+    auto& [gid, transfer] = find(params.at(0));
+    if (transfer.status == "complete" || transfer.status == "error" || transfer.status == "removed") {
+      throw Fault{1, std::format("Active Download not found for GID#{}", gid)};
+    }
+    transfer.status = "removed";
+    notify("aria2.onDownloadStop");
+    return gid;
+  }
+  if (method == "aria2.pause" || method == "aria2.forcePause") {
+    auto& [gid, transfer] = find(params.at(0));
+    if (transfer.status != "active") {
+      throw Fault{1, std::format("GID#{} cannot be paused now", gid)};
+    }
+    transfer.status = "paused";
+    notify("aria2.onDownloadPause");
+    return gid;
+  }
+  if (method == "aria2.unpause") {
+    auto& [gid, transfer] = find(params.at(0));
+    if (transfer.status != "paused") {
+      throw Fault{1, std::format("GID#{} cannot be unpaused now", gid)};
+    }
+    transfer.status = "active";
+    transfer.last_update = now;
+    notify("aria2.onDownloadStart");
+    return gid;
+  }
+  if (method == "aria2.pauseAll" || method == "aria2.forcePauseAll" || method == "aria2.unpauseAll") {
+    bool pausing = method != "aria2.unpauseAll";
+    for (auto& [gid, transfer] : transfers) {
+      advance(transfer, now);
+      if (transfer.status == (pausing ? "active" : "paused")) {
+        transfer.status = pausing ? "paused" : "active";
+        transfer.last_update = now;
+        notify(pausing ? "aria2.onDownloadPause" : "aria2.onDownloadStart");
+      }
+    }
+    return "OK";
+  }
+  if (method == "aria2.removeDownloadResult") {
+    auto& [gid, transfer] = find(params.at(0));
+    if (transfer.status == "active" || transfer.status == "paused") {
+      throw Fault{1, std::format("Could not remove download result of GID#{}", gid)};
+    }
+    transfers.erase(gid);
+    return "OK";
+  }
+  if (method == "aria2.changeOption" || method == "aria2.changeGlobalOption" || method == "aria2.saveSession") {
+    return "OK";
+  }
+  throw Fault{1, std::format("No such method: {}", method)};
+}
+
+json bench::MockAria2::status_of(const std::string& gid, Transfer& transfer, const json& keys) {
+  bool running = transfer.status == "active";
+  json status = {
+      {"gid", gid},
+      {"status", transfer.status},
+      {"totalLength", std::to_string(transfer.total_length)},
+      {"completedLength", std::to_string(transfer.completed_length)},
+      {"downloadSpeed", std::to_string(running ? transfer.speed : 0)},
+      {"connections", running ? "1" : "0"},
+  };
+  if (transfer.status == "error") {
+    status["errorCode"] = std::to_string(transfer.error_code);
+  }
+  if (keys.empty()) {
+    return status;
+  }
+  json selected = json::object();
+  for (const auto& key : keys) {
+    if (auto it = status.find(key.get<std::string>()); it != status.end()) {
+      selected[it.key()] = *it;
+    }
+  }
+  return selected;
+}
+
+void bench::MockAria2::advance(Transfer& transfer, std::chrono::steady_clock::time_point now) {
+  // Progress is worked out lazily, when a transfer is looked at, so idle transfers cost nothing
+  if (transfer.status != "active") {
+    return;
+  }
+  auto elapsed = std::chrono::duration<double>(now - transfer.last_update).count();
+  transfer.last_update = now;
+  auto progressed = static_cast<std::uint64_t>(elapsed * static_cast<double>(transfer.speed));
+  transfer.completed_length = std::min(transfer.total_length, transfer.completed_length + progressed);
+
+  if (transfer.fail_at && transfer.completed_length >= *transfer.fail_at) {
+    transfer.completed_length = *transfer.fail_at;
+    transfer.status = "error";
+    notify("aria2.onDownloadError");
+  } else if (transfer.completed_length == transfer.total_length) {
+    transfer.status = "complete";
+    notify("aria2.onDownloadComplete");
+  }
+}
+
+void bench::MockAria2::notify(const char* method) {
+  ++notification_counts[method];
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <optional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+
+namespace bench {
+
+// How the simulated transfers behave
+struct TransferProfile {
+  std::uint64_t total_length{4ULL * 1024 * 1024 * 1024};
+  std::uint64_t speed{64ULL * 1024 * 1024}; // bytes per second, per transfer
+  double failure_rate{0.0};                 // share of transfers that stop with `error_code` partway through
+  int error_code{22};                       // bad or unexpected HTTP response
+};
+
+// Stand-in for an aria2 daemon's JSON-RPC interface (POSIX only): enough of addUri, tellStatus, getGlobalStat, remove, pause,
+// unpause, saveSession and system.multicall to drive the monitor loop, with transfers that progress in simulated time.
+// Notifications (aria2.onDownloadStart etc.) are recorded rather than pushed, as aria2 only sends them over WebSocket.
+class MockAria2 {
+public:
+  explicit MockAria2(TransferProfile profile = {}, std::string secret = "nuclearlaunchcode", std::uint32_t seed = 1);
+
+  ~MockAria2();
+
+  MockAria2(const MockAria2&) = delete;
+  MockAria2& operator=(const MockAria2&) = delete;
+
+  // http://127.0.0.1:<port>/jsonrpc
+  std::string url() const;
+
+  // Applies to transfers added from now on
+  void set_profile(const TransferProfile& profile);
+
+  // HTTP requests served, and JSON-RPC calls handled (each call inside a multicall counts)
+  size_t requests() const noexcept {
+    return request_count;
+  }
+
+  size_t rpc_calls() const noexcept {
+    return rpc_count;
+  }
+
+  size_t notifications(std::string_view method) const;
+
+private:
+  struct Transfer {
+    std::string status{"active"}; // active, paused, error, complete or removed
+    std::uint64_t total_length;
+    std::uint64_t completed_length{0};
+    std::uint64_t speed;
+    std::optional<std::uint64_t> fail_at;
+    int error_code;
+    std::chrono::steady_clock::time_point last_update;
+  };
+
+  void serve();
+  std::string handle_request(std::string_view body);
+  nlohmann::json call(const std::string& method, nlohmann::json params);
+  nlohmann::json status_of(const std::string& gid, Transfer& transfer, const nlohmann::json& keys);
+  void advance(Transfer& transfer, std::chrono::steady_clock::time_point now);
+  void notify(const char* method);
+
+  TransferProfile profile;
+  std::string token;
+  std::mt19937 random;
+  std::uint64_t next_gid{1};
+  std::unordered_map<std::string, Transfer> transfers;
+  std::map<std::string, size_t, std::less<>> notification_counts;
+  mutable std::mutex mutex;
+
+  int listen_fd{-1};
+  std::uint16_t port{0};
+  std::atomic<bool> stopping{false};
+  std::atomic<size_t> request_count{0};
+  std::atomic<size_t> rpc_count{0};
+  std::thread server;
+};
+
+} // namespace bench
@@ -0,0 +1,133 @@
+// Times the aria2 monitor loop (monitor::poll plus the progress bar render) against the mock RPC server.
+// Usage: monitor_bench [ticks] [file counts...], e.g. `monitor_bench 5 10 1000 10000`
+#include "api.hpp"
+#include "aria2_manager.hpp"
+#include "logging.hpp"
+#include "mock_aria2.hpp"
+#include "monitor.hpp"
+#include "scheduler.hpp"
+#include "util.hpp"
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <format>
+#include <print>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+// CPU time of the calling thread only, so the mock server's work is left out
+double thread_cpu_ms() {
+  timespec now{};
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+  return static_cast<double>(now.tv_sec) * 1e3 + static_cast<double>(now.tv_nsec) / 1e6;
+}
+
+// Sends stdout to /dev/null while alive, so "Completed!" lines and progress bars cost what they cost without flooding the terminal
+class SilencedStdout {
+public:
+  SilencedStdout() : saved(dup(STDOUT_FILENO)) {
+    std::fflush(stdout);
+    int null_fd = open("/dev/null", O_WRONLY);
+    dup2(null_fd, STDOUT_FILENO);
+    close(null_fd);
+  }
+
+  ~SilencedStdout() {
+    std::fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+  }
+
+  SilencedStdout(const SilencedStdout&) = delete;
+  SilencedStdout& operator=(const SilencedStdout&) = delete;
+
+private:
+  int saved;
+};
+
+struct Result {
+  size_t files;
+  double requests_per_tick;
+  double rpc_per_tick;
+  double wall_ms_per_tick;
+  double cpu_ms_per_tick;
+  double render_ms_per_tick;
+  size_t failed;
+};
+
+Result run(size_t file_count, size_t ticks) {
+  // Slow enough that nothing finishes during the run, with 1% of the transfers failing along the way
+  bench::MockAria2 server{{.total_length = 4ULL << 30, .speed = 16ULL << 20, .failure_rate = 0.01, .error_code = 22}};
+  aria2::set_rpc_url(server.url());
+
+  api::ClientPool clients{{"bench"}};
+  scheduler::LazyQueue lazy_queue{clients};
+  std::vector<util::FileDownloadProgress> files;
+  files.reserve(file_count);
+  for (size_t i = 0; i < file_count; ++i) {
+    files.emplace_back(std::format("http://mock.invalid/file_{}", i), std::format("Season 01/file_{:05}.mkv", i), nlohmann::json{{"dir", "/tmp"}});
+  }
+  const size_t max_length = 25;
+  const size_t bar_length = 40;
+
+  Result result{file_count, 0, 0, 0, 0, 0, 0};
+  SilencedStdout silenced;
+  for (size_t tick = 0; tick < ticks; ++tick) {
+    auto requests_before = server.requests();
+    auto rpc_before = server.rpc_calls();
+    auto wall_start = std::chrono::steady_clock::now();
+    auto cpu_start = thread_cpu_ms();
+
+    result.failed += monitor::poll(files, lazy_queue, max_length + bar_length).failed;
+
+    auto cpu_polled = thread_cpu_ms();
+    auto wall_polled = std::chrono::steady_clock::now();
+    util::print_progress_bar(files, max_length, bar_length);
+    std::fflush(stdout);
+    auto wall_rendered = std::chrono::steady_clock::now();
+
+    result.requests_per_tick += static_cast<double>(server.requests() - requests_before);
+    result.rpc_per_tick += static_cast<double>(server.rpc_calls() - rpc_before);
+    result.wall_ms_per_tick += std::chrono::duration<double, std::milli>(wall_polled - wall_start).count();
+    result.cpu_ms_per_tick += cpu_polled - cpu_start;
+    result.render_ms_per_tick += std::chrono::duration<double, std::milli>(wall_rendered - wall_polled).count();
+  }
+
+  auto per_tick = static_cast<double>(ticks);
+  result.requests_per_tick /= per_tick;
+  result.rpc_per_tick /= per_tick;
+  result.wall_ms_per_tick /= per_tick;
+  result.cpu_ms_per_tick /= per_tick;
+  result.render_ms_per_tick /= per_tick;
+  return result;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  size_t ticks = argc > 1 ? std::stoul(argv[1]) : 5;
+  std::vector<size_t> file_counts;
+  for (int i = 2; i < argc; ++i) {
+    file_counts.push_back(std::stoul(argv[i]));
+  }
+  if (file_counts.empty()) {
+    file_counts = {10, 1000, 10000};
+  }
+
+  // The simulated failures would otherwise report one warning each
+  logging::start(logging::Level::Error, logging::Format::Human);
+
+  std::println("{:>8} {:>10} {:>10} {:>14} {:>13} {:>15} {:>7}", "files", "http/tick", "rpc/tick", "poll ms/tick", "cpu ms/tick", "render ms/tick",
+               "failed");
+  for (auto file_count : file_counts) {
+    auto result = run(file_count, ticks);
+    std::println("{:>8} {:>10.0f} {:>10.0f} {:>14.2f} {:>13.2f} {:>15.2f} {:>7}", result.files, result.requests_per_tick, result.rpc_per_tick,
+                 result.wall_ms_per_tick, result.cpu_ms_per_tick, result.render_ms_per_tick, result.failed);
+  }
+  return 0;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "api.hpp"
+#include "magnet.hpp"
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <vector>
+
+namespace admission {
+
+// Holds the magnets back until an account has room for them: Real-Debrid caps how many torrents each account may have
+// actively caching, and anything sent past that cap fails
+class Controller {
+public:
+  explicit Controller(api::ClientPool& clients) : clients(clients) {}
+
+  // Queues the magnets, instantly available ones first (they are done caching right away, so they never hold a slot)
+  void enqueue(std::vector<magnet::MagnetLink> magnets);
+
+  // Sends as many queued magnets as the accounts have free slots for, in queue order
+  std::vector<api::Torrent> admit();
+
+  // Like admit(), but waits for a slot to free up first if none is; empty once the queue is, or on shutdown
+  std::vector<api::Torrent> wait_and_admit();
+
+  bool empty() const noexcept {
+    return queue.empty();
+  }
+
+  size_t pending() const noexcept {
+    return queue.size();
+  }
+
+private:
+  struct Entry {
+    magnet::MagnetLink link;
+    bool cached;
+  };
+
+  api::ClientPool& clients;
+  std::deque<Entry> queue;
+};
+
+} // namespace admission
@@ -1,10 +1,13 @@
 #pragma once
 
+#include "async.hpp"
 #include <chrono>
-#include <cpr/cpr.h>
+#include <cstdint>
+#include <memory>
 #include <nlohmann/json.hpp>
 #include <optional>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace api {
@@ -13,12 +16,47 @@ struct Torrent {
   std::string id;
   std::string name;
   std::vector<std::string> files;
+  std::vector<std::uint64_t> file_sizes; // parallel to files, in bytes
   std::vector<std::string> links;
-  int size;
+  std::uint64_t size;
 };
 
 enum class HTTPMethod { GET, POST, PUT, DELETE };
 
+// One page of a listing endpoint, newest entries first
+struct Page {
+  nlohmann::json items;
+  std::uint64_t total_count; // X-Total-Count
+};
+
+// A live hoster link, as reported by /unrestrict/check
+struct LinkInfo {
+  std::string link;
+  std::string host;
+  std::string filename;
+  std::uint64_t size;
+};
+
+// Outcome of /unrestrict/check: the file's details if it is up, `dead` only once Real-Debrid said it is not;
+// neither when the check itself failed (rate limit, transport error, benched account)
+struct LinkCheck {
+  std::optional<LinkInfo> info;
+  bool dead{false};
+};
+
+// Outcome of adding a magnet: the torrent, or whether it failed on the account's quota (active torrent slots, traffic,
+// rate limit), which another account or a later try may not hit, rather than on the magnet itself
+struct AddResult {
+  std::optional<Torrent> torrent;
+  bool quota{false};
+};
+
+// Torrents an account has actively caching, out of how many it may (/torrents/activeCount)
+struct ActiveCount {
+  size_t active;
+  size_t limit;
+};
+
 constexpr std::chrono::seconds post_delay{1};
 
 class RealDebridClient {
@@ -26,20 +64,108 @@ public:
   explicit RealDebridClient(std::string token);
 
   // Sends magnet link, returns an optional (Torrent object)
-  std::optional<Torrent> send_magnet_link(const std::string& magnet) const;
+  AddResult send_magnet_link(const std::string& magnet) const;
 
   // Polls Real-Debrid to check if the torrent is ready for download
-  bool wait_for_status(const std::string& torrent_id, const std::string& desired_status, int torrent_size = 0) const;
+  bool wait_for_status(const std::string& torrent_id, const std::string& desired_status, std::uint64_t torrent_size = 0) const;
+
+  // Gets a list of download URLs from Real-Debrid, position for position; empty where a link could not be unrestricted
+  std::vector<std::optional<std::string>> get_download_links(const std::vector<std::string>& links);
+
+  // Coroutine counterparts of the above; any number of them can share one event loop (and thread)
+  async::Task<AddResult> send_magnet_link_async(async::EventLoop& loop, std::string magnet) const;
+
+  async::Task<bool> wait_for_status_async(async::EventLoop& loop, std::string torrent_id, std::string desired_status,
+                                          std::uint64_t torrent_size = 0) const;
+
+  // Unrestricts a single hoster link, returning the direct download URL
+  async::Task<std::optional<std::string>> unrestrict_async(async::EventLoop& loop, std::string link) const;
+
+  async::Task<std::vector<std::optional<std::string>>> get_download_links_async(async::EventLoop& loop, std::vector<std::string> links) const;
+
+  // Checks that a hoster link is supported and its file is still up, without spending an unrestrict
+  async::Task<LinkCheck> check_link_async(async::EventLoop& loop, std::string link) const;
+
+  async::Task<std::optional<ActiveCount>> active_count_async(async::EventLoop& loop) const;
+
+  // Which of the (lowercase hex) info hashes Real-Debrid reports as instantly available; nothing if it would not say
+  async::Task<std::optional<std::vector<std::string>>> instant_availability_async(async::EventLoop& loop, std::vector<std::string> hashes) const;
 
-  // Gets a list of download URLs from Real-Debrid
-  std::vector<std::string> get_download_links(const std::vector<std::string>& links);
+  // Fetches one page of /torrents or /downloads
+  async::Task<std::optional<Page>> list_async(async::EventLoop& loop, std::string endpoint, std::uint64_t offset, std::uint64_t limit) const;
+
+  // False while the account sits out a rate limit or quota error
+  bool is_available() const noexcept;
 
 private:
   static inline const std::string url{"https://api.real-debrid.com/rest/1.0"};
   std::string token;
-  cpr::Bearer bearer;
-  // Sends GET or POST request, parses response, and returns json object
-  std::optional<nlohmann::json> request_json(HTTPMethod method, const std::string& url_suffix, const cpr::Payload& payload = {}) const;
+  // API restricted to 250 requests per minute, per account
+  std::unique_ptr<async::RateLimiter> limiter;
+  mutable std::chrono::steady_clock::time_point cooldown_until{};
+  // Benches the account if the error says it is out of requests, slots or traffic; true if it did
+  bool record_error(long status_code, const nlohmann::json& error) const;
+  // Reports an HTTP error response and records it as above
+  bool handle_error(const async::HttpResponse& response, bool report) const;
+  // Sends a request and returns the response whatever its status, or nothing on transport errors
+  async::Task<std::optional<async::HttpResponse>> fetch_async(async::EventLoop& loop, HTTPMethod method, std::string url_suffix,
+                                                              async::Form form) const;
+  // Sends a request and returns the response, or nothing on transport/HTTP errors
+  async::Task<std::optional<async::HttpResponse>> send_request_async(async::EventLoop& loop, HTTPMethod method, std::string url_suffix,
+                                                                     async::Form form = {}, bool report_errors = true) const;
+  // Sends a request, parses the response, and returns the json object
+  async::Task<std::optional<nlohmann::json>> request_json_async(async::EventLoop& loop, HTTPMethod method, std::string url_suffix,
+                                                                async::Form form = {}) const;
+};
+
+// Several accounts behind one interface. A torrent stays with the account that added it (its id means nothing to the others),
+// everything else goes to whichever account is free, and accounts that hit a quota are skipped until they cool down
+class ClientPool {
+public:
+  explicit ClientPool(const std::vector<std::string>& tokens);
+
+  size_t size() const noexcept {
+    return clients.size();
+  }
+
+  // First account, for account-wide operations such as the library sync
+  const RealDebridClient& primary() const {
+    return clients.front();
+  }
+
+  bool is_available(size_t account) const noexcept {
+    return clients[account].is_available();
+  }
+
+  // Adds the torrent on that particular account
+  AddResult send_magnet_link_to(size_t account, const std::string& magnet);
+
+  // Active torrent counts of every account, fetched concurrently; empty where the request failed
+  std::vector<std::optional<ActiveCount>> active_counts() const;
+
+  // The hashes that are instantly available, asked in batches; stops asking at the first batch Real-Debrid will not answer
+  std::vector<std::string> cached_hashes(const std::vector<std::string>& hashes) const;
+
+  bool wait_for_status(const std::string& torrent_id, const std::string& desired_status, std::uint64_t torrent_size = 0) const;
+
+  // Unrestricts the links concurrently across every available account, position for position; empty where one failed
+  std::vector<std::optional<std::string>> get_download_links(const std::vector<std::string>& links);
+
+  // Checks the links concurrently across the available accounts, retrying a failed check on the next one
+  std::vector<LinkCheck> check_links(const std::vector<std::string>& links);
+
+  // Unrestricts on the next available account in turn, failing over if that account runs out of quota
+  async::Task<std::optional<std::string>> unrestrict_async(async::EventLoop& loop, std::string link);
+
+private:
+  const RealDebridClient& owner_of(const std::string& torrent_id) const;
+
+  // Checks on the available accounts in turn, starting at `first_account`, until one gets an answer
+  async::Task<LinkCheck> check_link_async(async::EventLoop& loop, std::string link, size_t first_account) const;
+
+  std::vector<RealDebridClient> clients;
+  std::unordered_map<std::string, size_t> torrent_owners;
+  size_t next_unrestrict{0};
 };
 
 } // namespace api
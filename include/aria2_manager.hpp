@@ -1,5 +1,7 @@
 #pragma once
 
+#include <chrono>
+#include <cstdint>
 #include <nlohmann/json.hpp>
 #include <optional>
 #include <string>
@@ -9,18 +11,84 @@ using json = nlohmann::json;
 
 namespace aria2 {
 
-void launch_aria2_handoff(const std::string& links_file);
+// Where the RPC daemon puts its files
+inline const std::string download_dir{"./Downloads"};
+
+// aria2's own record of unfinished downloads, written by aria2.saveSession and read back on startup
+inline const std::string session_file{download_dir + "/.aria2_session"};
+
+// Throughput related aria2 options, derived from the shape of a torrent
+struct TuningProfile {
+  size_t split{5};
+  size_t max_connection_per_server{1};
+  std::uint64_t min_split_size{20ULL * 1024 * 1024};
+  std::uint64_t disk_cache{16ULL * 1024 * 1024};
+  std::string file_allocation{"falloc"};
+  size_t max_concurrent_downloads{5};
+
+  // Command line form, e.g. "--split=16"
+  std::vector<std::string> to_arguments() const;
+
+  // Option object for aria2.changeGlobalOption / aria2.addUri
+  json to_options() const;
+};
+
+// Picks split/connection/cache settings from the number of downloads and the file sizes (bytes)
+TuningProfile derive_tuning_profile(size_t download_count, const std::vector<std::uint64_t>& file_sizes);
 
 bool is_rpc_running();
 
-bool launch_aria2_daemon();
+// Points every RPC call at another endpoint, such as the mock server used by the bench
+void set_rpc_url(std::string url);
+
+// Starts the RPC daemon (or retunes an already running one) and waits until it answers
+bool launch_aria2_daemon(const TuningProfile& profile = {}, std::chrono::milliseconds timeout = std::chrono::seconds(10));
+
+bool rpc_change_global_option(const json& options);
+
+// Changes options of individual downloads in one batched call; returns how many took them.
+// aria2 restarts active downloads to apply connection settings, resuming from where they were
+size_t rpc_change_options(const std::vector<std::string>& gids, const json& options);
+
+// aria2.getGlobalStat, the aggregate over every download
+struct GlobalStat {
+  std::uint64_t download_speed{0}; // bytes per second
+  size_t active{0};
+  size_t waiting{0};
+};
 
-std::optional<std::string> rpc_add_download(const std::string& link);
+std::optional<GlobalStat> rpc_get_global_stat();
+
+// Options are per-download aria2 options such as "dir" and "out"
+std::optional<std::string> rpc_add_download(const std::string& link, const json& options = json::object());
 
 std::optional<json> rpc_get_status(const std::string& gid);
 
+// tellStatus for every GID in one batched call, position for position; empty where aria2 returned a fault (or the call failed)
+std::vector<std::optional<json>> rpc_get_statuses(const std::vector<std::string>& gids);
+
 bool rpc_remove_download(const std::string& gid);
 
+// Paths aria2 wrote a download's files to (aria2.getFiles)
+std::vector<std::string> rpc_get_file_paths(const std::string& gid);
+
+// Forgets a stopped (complete, errored or removed) download so its slot in the results list is freed
+bool rpc_remove_download_result(const std::string& gid);
+
+// Pauses every GID in one batched call without waiting on the servers; returns how many were paused
+size_t rpc_pause_downloads(const std::vector<std::string>& gids);
+
+// Unpauses every GID in one batched call; returns the GIDs aria2 knew about and resumed
+std::vector<std::string> rpc_unpause_downloads(const std::vector<std::string>& gids);
+
+bool rpc_save_session();
+
+// aria2 error codes that point at the URL rather than at the local disk, so a fresh link may help
+bool is_link_error(int error_code);
+
+// The subset of link errors that point at an overloaded server, where fewer connections help
+bool is_congestion_error(int error_code);
+
 void shutdown();
 
 } // namespace aria2
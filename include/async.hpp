@@ -0,0 +1,375 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <coroutine>
+#include <curl/curl.h>
+#include <exception>
+#include <map>
+#include <optional>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace async {
+
+template <typename T> class Task;
+
+namespace detail {
+
+template <typename T> struct PromiseStorage {
+  std::optional<T> value;
+
+  void return_value(T result) {
+    value.emplace(std::move(result));
+  }
+
+  T take() {
+    return std::move(*value);
+  }
+};
+
+template <> struct PromiseStorage<void> {
+  void return_void() noexcept {}
+
+  void take() noexcept {}
+};
+
+template <typename T> struct Promise : PromiseStorage<T> {
+  std::coroutine_handle<> continuation;
+  std::exception_ptr exception;
+  bool started{false};
+
+  Task<T> get_return_object() noexcept;
+
+  std::suspend_always initial_suspend() noexcept {
+    return {};
+  }
+
+  auto final_suspend() noexcept {
+    // Hands control straight back to whoever awaited us
+    struct FinalAwaiter {
+      bool await_ready() noexcept {
+        return false;
+      }
+
+      std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+        auto continuation = handle.promise().continuation;
+        return continuation ? continuation : std::noop_coroutine();
+      }
+
+      void await_resume() noexcept {}
+    };
+    return FinalAwaiter{};
+  }
+
+  void unhandled_exception() noexcept {
+    exception = std::current_exception();
+  }
+};
+
+} // namespace detail
+
+// Lazily started coroutine; it runs once awaited (or start()ed) and resumes its awaiter when it finishes
+template <typename T = void> class [[nodiscard]] Task {
+public:
+  using promise_type = detail::Promise<T>;
+  using handle_type = std::coroutine_handle<promise_type>;
+
+  explicit Task(handle_type handle) noexcept : handle(handle) {}
+
+  Task(Task&& other) noexcept : handle(std::exchange(other.handle, {})) {}
+
+  Task& operator=(Task&& other) noexcept {
+    if (this != &other) {
+      if (handle) {
+        handle.destroy();
+      }
+      handle = std::exchange(other.handle, {});
+    }
+    return *this;
+  }
+
+  Task(const Task&) = delete;
+  Task& operator=(const Task&) = delete;
+
+  ~Task() {
+    if (handle) {
+      handle.destroy();
+    }
+  }
+
+  // Runs the coroutine up to its first suspension point without waiting for it
+  void start() {
+    if (!handle.promise().started) {
+      handle.promise().started = true;
+      handle.resume();
+    }
+  }
+
+  bool done() const noexcept {
+    return handle.done();
+  }
+
+  // Result of a finished task, rethrowing whatever it threw
+  T result() {
+    if (handle.promise().exception) {
+      std::rethrow_exception(handle.promise().exception);
+    }
+    return handle.promise().take();
+  }
+
+  auto operator co_await() noexcept {
+    struct Awaiter {
+      Task& task;
+
+      bool await_ready() const noexcept {
+        return task.handle.done();
+      }
+
+      std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+        auto& promise = task.handle.promise();
+        promise.continuation = awaiting;
+        if (!promise.started) {
+          promise.started = true;
+          return task.handle;
+        }
+        return std::noop_coroutine();
+      }
+
+      T await_resume() {
+        return task.result();
+      }
+    };
+    return Awaiter{*this};
+  }
+
+private:
+  handle_type handle;
+};
+
+template <typename T> Task<T> detail::Promise<T>::get_return_object() noexcept {
+  return Task<T>{std::coroutine_handle<Promise<T>>::from_promise(*this)};
+}
+
+// Starts every task before awaiting any of them, so they all make progress together
+template <typename T> Task<std::vector<T>> gather(std::vector<Task<T>> tasks) {
+  for (auto& task : tasks) {
+    task.start();
+  }
+  std::vector<T> results;
+  results.reserve(tasks.size());
+  for (auto& task : tasks) {
+    results.push_back(co_await task);
+  }
+  co_return results;
+}
+
+inline Task<void> gather(std::vector<Task<void>> tasks) {
+  for (auto& task : tasks) {
+    task.start();
+  }
+  for (auto& task : tasks) {
+    co_await task;
+  }
+}
+
+using Form = std::vector<std::pair<std::string, std::string>>;
+
+// Percent-encodes fields as an application/x-www-form-urlencoded body
+std::string form_encode(const Form& fields);
+
+struct HttpRequest {
+  std::string method{"GET"};
+  std::string url;
+  std::vector<std::string> headers; // "Name: value"
+  std::string body;
+  std::chrono::milliseconds timeout{std::chrono::seconds(30)};
+  bool decode_content{true}; // ask for compression and decode it; off where the body must be the bytes as stored (ranges)
+};
+
+struct HttpResponse {
+  long status_code{0};
+  std::string text;
+  std::map<std::string, std::string> headers; // lowercase names
+  std::string error;                          // transport error, if any
+  bool cancelled{false};
+};
+
+class EventLoop;
+
+class SleepAwaiter {
+public:
+  SleepAwaiter(EventLoop& loop, std::chrono::steady_clock::duration duration) : loop(loop), duration(duration) {}
+
+  SleepAwaiter(const SleepAwaiter&) = delete;
+  SleepAwaiter& operator=(const SleepAwaiter&) = delete;
+
+  // Leaves the timer queue if the awaiting coroutine is destroyed while asleep
+  ~SleepAwaiter();
+
+  bool await_ready() const noexcept;
+
+  void await_suspend(std::coroutine_handle<> handle);
+
+  // False when the sleep was cut short by cancellation
+  bool await_resume() const noexcept {
+    return !cancelled;
+  }
+
+private:
+  friend class EventLoop;
+  EventLoop& loop;
+  std::chrono::steady_clock::duration duration;
+  std::chrono::steady_clock::time_point deadline;
+  std::coroutine_handle<> waiter;
+  bool registered{false};
+  bool cancelled{false};
+};
+
+class WakeAwaiter {
+public:
+  explicit WakeAwaiter(EventLoop& loop) : loop(loop) {}
+
+  WakeAwaiter(const WakeAwaiter&) = delete;
+  WakeAwaiter& operator=(const WakeAwaiter&) = delete;
+
+  // Leaves the wait list if the awaiting coroutine is destroyed while waiting
+  ~WakeAwaiter();
+
+  bool await_ready() const noexcept;
+
+  void await_suspend(std::coroutine_handle<> handle);
+
+  // False when the wait was cut short by cancellation
+  bool await_resume() const noexcept {
+    return !cancelled;
+  }
+
+private:
+  friend class EventLoop;
+  EventLoop& loop;
+  std::coroutine_handle<> waiter;
+  bool registered{false};
+  bool cancelled{false};
+};
+
+class TransferAwaiter {
+public:
+  TransferAwaiter(EventLoop& loop, HttpRequest request) : loop(loop), request(std::move(request)) {}
+
+  TransferAwaiter(const TransferAwaiter&) = delete;
+  TransferAwaiter& operator=(const TransferAwaiter&) = delete;
+
+  ~TransferAwaiter();
+
+  bool await_ready() noexcept;
+
+  bool await_suspend(std::coroutine_handle<> handle);
+
+  HttpResponse await_resume() noexcept {
+    return std::move(response);
+  }
+
+private:
+  friend class EventLoop;
+
+  static size_t write_callback(char* data, size_t size, size_t count, void* user);
+  static size_t header_callback(char* data, size_t size, size_t count, void* user);
+
+  // Called by the loop once curl is done with the handle (or it was cancelled)
+  void complete(CURLcode result);
+
+  EventLoop& loop;
+  HttpRequest request;
+  HttpResponse response;
+  CURL* easy{nullptr};
+  curl_slist* header_list{nullptr};
+  std::array<char, CURL_ERROR_SIZE> error_buffer{};
+  std::coroutine_handle<> waiter;
+};
+
+// Single threaded scheduler: timers plus libcurl's multi interface for every HTTP transfer in flight
+class EventLoop {
+public:
+  EventLoop();
+
+  ~EventLoop();
+
+  EventLoop(const EventLoop&) = delete;
+  EventLoop& operator=(const EventLoop&) = delete;
+
+  // Drives the loop until the task finishes and returns its result
+  template <typename T> T run(Task<T> task) {
+    task.start();
+    while (!task.done()) {
+      step();
+    }
+    return task.result();
+  }
+
+  // Runs a task in the background; the loop owns it until it finishes
+  void spawn(Task<void> task);
+
+  // Resumes every pending sleep and transfer as cancelled; later awaits complete immediately
+  void cancel_all();
+
+  bool is_cancelled() const noexcept {
+    return cancelled;
+  }
+
+  SleepAwaiter sleep_for(std::chrono::steady_clock::duration duration) {
+    return SleepAwaiter{*this, duration};
+  }
+
+  TransferAwaiter fetch(HttpRequest request) {
+    return TransferAwaiter{*this, std::move(request)};
+  }
+
+  // Suspends until the next wake(), for state that another thread changes
+  WakeAwaiter woken() {
+    return WakeAwaiter{*this};
+  }
+
+  // Resumes whatever waits in woken(); the only member that may be called from another thread
+  void wake() noexcept;
+
+  size_t transfers_in_flight() const noexcept {
+    return transfers.size();
+  }
+
+private:
+  friend class SleepAwaiter;
+  friend class WakeAwaiter;
+  friend class TransferAwaiter;
+
+  // One round: fire due timers, let curl make progress, resume finished transfers, then wait for activity
+  void step();
+
+  CURLM* multi;
+  std::multimap<std::chrono::steady_clock::time_point, SleepAwaiter*> timers;
+  std::unordered_set<TransferAwaiter*> transfers;
+  std::vector<WakeAwaiter*> wake_waiters;
+  std::vector<WakeAwaiter*> waking; // taken from wake_waiters for the current round, still to be resumed
+  std::atomic<bool> wake_pending{false};
+  std::vector<Task<void>> spawned;
+  bool cancelled{false};
+};
+
+// Spaces acquisitions out to `rate_per_sec`, allowing bursts of up to `capacity`; it can outlive (and be shared by) several loops
+class RateLimiter {
+public:
+  RateLimiter(size_t capacity, double rate_per_sec);
+
+  // Waits for a slot on `loop`; false if the loop was cancelled meanwhile
+  Task<bool> acquire(EventLoop& loop);
+
+private:
+  std::chrono::steady_clock::duration interval;
+  std::chrono::steady_clock::duration burst;
+  std::chrono::steady_clock::time_point next_arrival;
+};
+
+} // namespace async
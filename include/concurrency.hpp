@@ -0,0 +1,71 @@
+#pragma once
+
+#include "util.hpp"
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace concurrency {
+
+// The runtime knobs of the aria2 daemon
+struct Limits {
+  size_t slots;       // max-concurrent-downloads
+  size_t connections; // split and max-connection-per-server of each download
+
+  bool operator==(const Limits&) const = default;
+};
+
+struct Adjustment {
+  Limits limits;
+  std::vector<std::pair<std::string, size_t>> host_connections; // hosts that showed congestion, with their new connection cap
+};
+
+// AIMD over the aria2 knobs, judged by the aggregate download speed once per window: one knob goes up by one at a time
+// and stays only if the speed rose with it; congestion errors halve the connections (globally, and for the offending host)
+class Controller {
+public:
+  Controller(Limits start, Limits ceiling, std::chrono::steady_clock::duration window = std::chrono::seconds(5));
+
+  void observe_speed(std::uint64_t bytes_per_second);
+
+  void observe_error(std::string_view host);
+
+  // Closes the window once it has run its length; returns what to change, if anything
+  std::optional<Adjustment> step(std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now());
+
+  const Limits& limits() const noexcept {
+    return current;
+  }
+
+private:
+  enum class Knob { None, Slots, Connections };
+
+  void probe();
+
+  Limits current;
+  Limits ceiling;
+  std::chrono::steady_clock::duration window;
+  std::chrono::steady_clock::time_point window_start;
+
+  // Speed samples and congestion errors of the running window
+  std::uint64_t speed_sum{0};
+  size_t samples{0};
+  std::map<std::string, size_t, std::less<>> errors;
+
+  std::map<std::string, size_t, std::less<>> host_caps; // connection caps of the hosts still backed off
+  double baseline{0};       // mean speed before the knob in `probing` went up
+  Knob probing{Knob::None};
+  Knob next_knob{Knob::Connections};
+  size_t hold_windows{1};   // windows left to wait before probing again
+};
+
+// Pushes an adjustment to the aria2 daemon: global options for new downloads, the connection count to every unfinished one, then
+// the congested hosts' own caps
+void apply(const Adjustment& adjustment, const std::vector<util::FileDownloadProgress>& files);
+
+} // namespace concurrency
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace content_index {
+
+struct Entry {
+  std::uint64_t size;
+  std::int64_t mtime; // raw file clock ticks
+  std::uint64_t hash; // XXH64 of the contents; 0 while still in progress
+  bool verified;      // complete, and unchanged since it was last seen complete
+};
+
+// Streaming XXH64, used to fingerprint downloaded files
+class Hasher {
+public:
+  explicit Hasher(std::uint64_t seed = 0);
+
+  void update(const std::byte* data, size_t length);
+
+  std::uint64_t digest() const;
+
+private:
+  std::uint64_t total_length{0};
+  std::uint64_t accumulators[4];
+  std::byte buffer[32];
+  size_t buffered{0};
+  std::uint64_t seed;
+};
+
+// Hashes a whole file, memory mapping it where possible
+std::optional<std::uint64_t> hash_file(const std::filesystem::path& path);
+
+// Persistent record of what is already present in a download directory
+class ContentIndex {
+public:
+  explicit ContentIndex(std::filesystem::path root);
+
+  // Reads the index file, if there is one
+  void load();
+
+  // Writes the index file (temp file + rename)
+  bool save() const;
+
+  // Re-stats the given files (relative to root) and hashes the new or changed ones across all cores
+  void refresh(const std::vector<std::string>& relative_paths);
+
+  // Whether the file is on disk, complete and, when known, of the expected size
+  bool is_present(const std::string& relative_path, std::uint64_t expected_size = 0) const;
+
+  const std::filesystem::path& get_root() const noexcept {
+    return root;
+  }
+
+private:
+  std::filesystem::path root;
+  std::filesystem::path index_path;
+  std::unordered_map<std::string, Entry> entries;
+};
+
+} // namespace content_index
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "api.hpp"
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace hoster {
+
+struct IngestStats {
+  size_t lines{0};
+  size_t invalid{0};
+  size_t duplicates{0};
+};
+
+// Host part of an http(s) URL, without "www."; nothing for anything else
+std::optional<std::string_view> host_of(std::string_view url);
+
+// Reads one hoster link per line, dropping blanks, '#' comments, non-http(s) lines and repeats
+std::vector<std::string> ingest(std::string_view contents, IngestStats& stats);
+
+// One pseudo-torrent per host (in first-seen order), so the live links go through the same unrestrict and download steps as a torrent
+std::vector<api::Torrent> group_by_host(const std::vector<api::LinkInfo>& live_links);
+
+} // namespace hoster
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "api.hpp"
+#include "async.hpp"
+#include "util.hpp"
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace library {
+
+inline const std::filesystem::path default_path{".rddl_library"};
+
+enum class Kind : std::uint8_t { Torrent, Download };
+
+struct Entry {
+  Kind kind;
+  std::string id;
+  std::string name;
+  std::string hash;   // torrents only, lowercase hex
+  std::string status; // torrent status, or the hoster for downloads
+  std::string link;   // downloads only, the unrestricted URL
+  std::uint64_t bytes;
+  std::int64_t added; // unix seconds
+
+  bool operator==(const Entry&) const = default;
+};
+
+struct Query {
+  std::string text;   // matched against name (substring), hash (prefix) and id
+  std::string status; // exact match, empty for any
+  std::optional<Kind> kind;
+  std::int64_t since{0};
+  std::int64_t until{INT64_MAX};
+};
+
+struct SyncStats {
+  size_t added{0};
+  size_t updated{0};
+  size_t total{0};
+  bool full_resync{false};
+};
+
+// Parses "YYYY-MM-DD" or an ISO 8601 timestamp such as Real-Debrid's "2024-01-31T12:00:00.000Z"
+std::optional<std::int64_t> parse_timestamp(std::string_view text);
+
+std::string format_date(std::int64_t timestamp);
+
+// Local, memory mapped mirror of the account's torrents and downloads
+class Library {
+public:
+  explicit Library(std::filesystem::path path = default_path);
+
+  // Maps the library file; a missing file is an empty library
+  bool open();
+
+  // Copies out every entry of one kind, newest first
+  std::vector<Entry> entries(Kind kind) const;
+
+  // Scans the mapped records in place and copies out up to `limit` matches
+  std::vector<Entry> find(const Query& query, size_t limit = 50) const;
+
+  // Rewrites the file (temp file + rename) and maps the new contents
+  bool write(const std::vector<Entry>& torrents, const std::vector<Entry>& downloads);
+
+  size_t size() const noexcept {
+    return record_count;
+  }
+
+private:
+  // Unmaps the file and forgets the views into it
+  void close();
+
+  Entry read_entry(size_t index) const;
+
+  std::filesystem::path path;
+  std::optional<util::MappedFile> mapping;
+  size_t record_count{0};
+  std::string_view records;
+  std::string_view strings;
+};
+
+// Pages through /torrents and /downloads, fetching only what changed since the last sync
+async::Task<std::optional<SyncStats>> sync_async(async::EventLoop& loop, const api::RealDebridClient& client, Library& library);
+
+} // namespace library
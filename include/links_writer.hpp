@@ -0,0 +1,26 @@
+#pragma once
+
+#include "api.hpp"
+#include "aria2_manager.hpp"
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace links_writer {
+
+enum class Format {
+  Plain,    // one bare URL per line
+  Aria2,    // aria2 input file (-i) with per-file dir=, out= and split= options
+  Metalink, // Metalink 4 (RFC 5854), for aria2's -M or any other downloader
+  JsonLines // one {"url", "file", "size", "torrent"} object per line
+};
+
+std::optional<Format> parse_format(std::string_view name);
+
+// Suffix appended to the torrent name, e.g. "_links.meta4"
+std::string_view file_suffix(Format format);
+
+// Renders every link of a torrent; `dir` is where the files should land and `profile` supplies the split hints
+std::string render(Format format, const api::Torrent& torrent, const std::string& dir, const aria2::TuningProfile& profile = {});
+
+} // namespace links_writer
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <format>
+#include <optional>
+#include <string_view>
+#include <utility>
+
+namespace logging {
+
+enum class Level : std::uint8_t { Debug, Info, Warn, Error, Off };
+
+enum class Format { Human, JsonLines };
+
+std::optional<Level> parse_level(std::string_view name);
+
+// Longest message kept per record; anything past it is cut off
+constexpr size_t max_message_length = 440;
+
+namespace detail {
+
+inline std::atomic<Level> threshold{Level::Info};
+
+void push(Level level, std::string_view module, std::string_view message, bool truncated) noexcept;
+
+} // namespace detail
+
+// Starts the writer thread on `fd`; until then (and in tools that never call it) records are written synchronously to stderr
+void start(Level level, Format format, int fd = 2);
+
+// Drains what is queued and stops the writer; also runs at exit
+void stop();
+
+inline bool enabled(Level level) noexcept {
+  return level >= detail::threshold.load(std::memory_order_relaxed);
+}
+
+// Formats into a fixed buffer on the stack and queues the record without allocating; `module` must be a string literal,
+// as only the view is kept. When the writer falls behind, debug and info records are dropped (and counted) rather than block
+template <typename... Args> void write(Level level, std::string_view module, std::format_string<Args...> format, Args&&... args) {
+  if (!enabled(level)) {
+    return;
+  }
+  std::array<char, max_message_length> text;
+  auto result = std::format_to_n(text.data(), static_cast<std::ptrdiff_t>(text.size()), format, std::forward<Args>(args)...);
+  auto length = std::min(static_cast<size_t>(result.size), text.size());
+  detail::push(level, module, {text.data(), length}, static_cast<size_t>(result.size) > text.size());
+}
+
+template <typename... Args> void debug(std::string_view module, std::format_string<Args...> format, Args&&... args) {
+  write(Level::Debug, module, format, std::forward<Args>(args)...);
+}
+
+template <typename... Args> void info(std::string_view module, std::format_string<Args...> format, Args&&... args) {
+  write(Level::Info, module, format, std::forward<Args>(args)...);
+}
+
+template <typename... Args> void warn(std::string_view module, std::format_string<Args...> format, Args&&... args) {
+  write(Level::Warn, module, format, std::forward<Args>(args)...);
+}
+
+template <typename... Args> void error(std::string_view module, std::format_string<Args...> format, Args&&... args) {
+  write(Level::Error, module, format, std::forward<Args>(args)...);
+}
+
+} // namespace logging
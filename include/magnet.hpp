@@ -0,0 +1,51 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+namespace magnet {
+
+using InfoHash = std::array<std::uint8_t, 20>;
+
+struct InfoHashHash {
+  size_t operator()(const InfoHash& hash) const noexcept {
+    // Info hashes are SHA-1 digests, so any 8 bytes are already well distributed
+    size_t value;
+    std::memcpy(&value, hash.data(), sizeof(value));
+    return value;
+  }
+};
+
+using InfoHashSet = std::unordered_set<InfoHash, InfoHashHash>;
+
+// Parsed magnet URI; the views point into the original text
+struct MagnetLink {
+  std::string_view uri;
+  InfoHash info_hash;
+  std::string_view display_name; // still percent-encoded
+  std::vector<std::string_view> trackers;
+
+  // Lowercase hex form of the info hash, whichever encoding the URI used
+  std::string hex_hash() const;
+};
+
+// Parses a BitTorrent magnet URI, accepting hex or base32 info hashes
+std::optional<MagnetLink> parse(std::string_view uri);
+
+struct IngestStats {
+  size_t lines{0};
+  size_t invalid{0};
+  size_t duplicates{0};
+};
+
+// Parses one magnet per line, dropping invalid entries and repeats of an info hash already in `seen`
+std::vector<MagnetLink> ingest(std::string_view contents, InfoHashSet& seen, IngestStats& stats);
+
+} // namespace magnet
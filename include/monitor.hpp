@@ -0,0 +1,22 @@
+#pragma once
+
+#include "scheduler.hpp"
+#include "util.hpp"
+#include <string>
+#include <vector>
+
+namespace monitor {
+
+struct TickStats {
+  size_t rpc_calls{0}; // round trips to aria2, one multicall per tick
+  size_t completed{0}; // files that finished during this tick
+  size_t failed{0};    // files aria2 gave up on for good during this tick
+  std::vector<size_t> finished;             // indices into `files` of the downloads aria2 completed during this tick
+  std::vector<std::string> congested_links; // links whose server turned away or timed out a transfer, see aria2::is_congestion_error
+};
+
+// One pass of the monitor loop: refreshes every unfinished file from aria2 in one batch, restarting or failing the ones aria2 gave up on.
+// `label_width` aligns the "Completed!"/"Failed!" lines with the progress bars
+TickStats poll(std::vector<util::FileDownloadProgress>& files, scheduler::LazyQueue& lazy_queue, size_t label_width);
+
+} // namespace monitor
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "api.hpp"
+#include "util.hpp"
+#include <deque>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <vector>
+
+namespace scheduler {
+
+// A file whose direct URL is only fetched shortly before aria2 can start it
+struct PendingFile {
+  std::string source; // hoster link, as listed in Torrent::links
+  std::string name;
+  nlohmann::json options;
+};
+
+// Unrestricts links just in time, so they cannot expire in aria2's queue and API calls follow actual downloads
+class LazyQueue {
+public:
+  explicit LazyQueue(api::ClientPool& clients, size_t lookahead = 2, size_t max_restarts = 3);
+
+  void push(PendingFile file);
+
+  // Adds downloads to aria2 until `slots` plus the look-ahead window are taken by unfinished files
+  void fill(std::vector<util::FileDownloadProgress>& files, size_t slots);
+
+  // Re-unrestricts a file whose URL aria2 gave up on; false once it has no source or no restarts left
+  bool retry(util::FileDownloadProgress& file);
+
+  bool empty() const noexcept {
+    return pending.empty();
+  }
+
+  size_t size() const noexcept {
+    return pending.size();
+  }
+
+  const std::deque<PendingFile>& get_pending() const noexcept {
+    return pending;
+  }
+
+  // Longest pending file name, for aligning the progress bars
+  size_t longest_name() const noexcept;
+
+private:
+  api::ClientPool& clients;
+  size_t lookahead;
+  size_t max_restarts;
+  std::deque<PendingFile> pending;
+};
+
+} // namespace scheduler
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "aria2_manager.hpp"
+#include "scheduler.hpp"
+#include "util.hpp"
+#include <nlohmann/json.hpp>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace session {
+
+// Our side of an interrupted run; aria2 keeps its own in aria2::session_file
+inline const std::string state_file{aria2::download_dir + "/.rddl_session.json"};
+
+struct PausedDownload {
+  std::string gid;
+  std::string link;
+  std::string name;
+  std::string source; // hoster link for lazily scheduled files
+  nlohmann::json options;
+};
+
+struct State {
+  std::vector<PausedDownload> downloads;
+  std::vector<scheduler::PendingFile> pending; // lazily scheduled files aria2 never got to see
+  std::vector<std::string> indexed_files;
+  size_t slots{1};
+};
+
+std::optional<State> load(const std::string& path = state_file);
+
+bool save(const State& state, const std::string& path = state_file);
+
+// Drops the state once it has been resumed, so it is not picked up twice
+void discard(const std::string& path = state_file);
+
+// Pauses every unfinished download in one batched call, then saves aria2's session and our state; returns how many were paused
+size_t pause_and_persist(const std::vector<util::FileDownloadProgress>& files, const scheduler::LazyQueue& lazy_queue,
+                         const std::vector<std::string>& indexed_files, size_t slots);
+
+// Unpauses what an earlier run left behind and rebuilds its files; anything aria2 lost is added again (or requeued)
+void resume(const State& state, std::vector<util::FileDownloadProgress>& files, scheduler::LazyQueue& lazy_queue);
+
+} // namespace session
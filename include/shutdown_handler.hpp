@@ -10,9 +10,11 @@ extern std::atomic<bool> shutdown_requested;
 #ifdef _WIN32
 BOOL WINAPI console_handler(DWORD signal);
 #else
+// Async-signal-safe: only sets the flag and writes to the self-pipe, a watcher thread does the rest
 void handle_signal(int signal);
 #endif
 
+// A second signal while shutting down exits at once
 void register_handler();
 
 } // namespace shutdown_handler
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace staging {
+
+enum class Method { Rename, Reflink, CopyFileRange, Copy };
+
+const char* method_name(Method method);
+
+// Moves a finished file to `to`, creating its directories: a rename on the same filesystem, otherwise a reflink,
+// copy_file_range or plain copy into a temporary name next to `to`, renamed into place once complete
+std::optional<Method> move_file(const std::filesystem::path& from, const std::filesystem::path& to);
+
+// Bounded set of background workers moving finished downloads out of the staging directory while others still run
+class Finalizer {
+public:
+  explicit Finalizer(size_t workers = 2);
+
+  // Waits for every queued move
+  ~Finalizer();
+
+  Finalizer(const Finalizer&) = delete;
+  Finalizer& operator=(const Finalizer&) = delete;
+
+  void submit(std::filesystem::path from, std::filesystem::path to);
+
+  struct Totals {
+    size_t moved{0};
+    size_t failed{0};
+    size_t copied{0}; // moves that crossed filesystems
+  };
+
+  // Blocks until everything submitted so far is in place; the totals count since the previous wait
+  Totals wait();
+
+private:
+  void run();
+
+  size_t worker_count;
+  std::vector<std::thread> workers; // started on the first submit
+  std::deque<std::pair<std::filesystem::path, std::filesystem::path>> jobs;
+  size_t in_progress{0};
+  Totals totals;
+  bool stopping{false};
+  std::mutex mutex;
+  std::condition_variable job_ready;
+  std::condition_variable idle;
+};
+
+} // namespace staging
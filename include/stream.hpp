@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+
+namespace stream {
+
+struct Options {
+  std::uint64_t chunk_size{8ULL * 1024 * 1024}; // bytes per range request
+  size_t parallel{4};                           // range requests in flight
+  size_t buffered_chunks{8};                    // ring buffer slots; bounds both read-ahead and memory
+  size_t max_retries{3};                        // per chunk
+};
+
+// Opens where --stream writes to: "-" is stdout, in which case our own output moves to stderr so the data stays clean;
+// anything else is a FIFO (created if missing) or file. Blocks until a FIFO has a reader
+std::optional<int> open_output(const std::string& target);
+
+// Fetches `url` in order with parallel range requests and writes it to `fd` as the chunks line up, without touching the disk.
+// Returns the number of bytes written, or nothing if the server, the network or the reader gave up
+std::optional<std::uint64_t> pipe_url(const std::string& url, int fd, const Options& options = {});
+
+} // namespace stream
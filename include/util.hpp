@@ -1,27 +1,27 @@
 #pragma once
 
-#include <chrono>
+#include "logging.hpp"
 #include <cstdlib>
-#include <iostream>
-#include <mutex>
+#include <nlohmann/json.hpp>
+#include <optional>
+#include <stdexcept>
 #include <string>
-#include <thread>
-#include <tuple>
+#include <string_view>
+#include <vector>
 
 namespace util {
 
 [[noreturn]] inline void fatal_error(const std::string& message) {
-  std::cerr << "Error: " << message << std::endl;
+  logging::error("rddl", "{}", message);
   throw std::runtime_error(message);
 }
 
+// Queued log records are still written out, by the logger's exit handler
 [[noreturn]] inline void fatal_exit(const std::string& message, int exit_code = 1) {
-  std::cerr << "Fatal: " << message << std::endl;
+  logging::error("rddl", "Fatal: {}", message);
   std::exit(exit_code);
 }
 
-bool validate_magnet_link(const std::string& magnet);
-
 inline void set_env_variable(const std::string& key, const std::string& value) {
 #ifdef _WIN32
   _putenv_s(key.c_str(), value.c_str());
@@ -32,37 +32,59 @@ inline void set_env_variable(const std::string& key, const std::string& value) {
 
 void load_env_file(const std::string& path);
 
-std::string get_rd_token(std::string& cli_token);
+// One token, or several separated by commas to spread the work over more than one account
+std::vector<std::string> get_rd_tokens(const std::string& cli_token);
+
+struct Arguments {
+  std::string api_token;
+  std::string magnet;
+  std::string magnet_file;
+  std::string hoster_file;
+  bool links_flag{false};
+  std::string output_path;
+  std::string format{"plain"};
+  bool aria2_flag{false};
+  bool lazy_flag{false};
+  bool fixed_flag{false};
+  std::string staging_dir;
+  std::optional<std::string> stream_target;
+  std::string log_level{"info"};
+  std::string log_format{"human"};
+  bool resume_flag{false};
+  bool sync_flag{false};
+  std::optional<std::string> search;
+  std::string status;
+  std::string since;
+  size_t search_limit{50};
+};
 
-std::tuple<std::string, std::string, bool, std::string, bool> parse_arguments(int argc, char* argv[]);
+Arguments parse_arguments(int argc, char* argv[]);
 
-// The following class helps with parallelization of link unrestriction
-class TokenBucket {
+// Read-only view of a whole file, memory mapped where the platform allows it
+class MappedFile {
 public:
-  // Constructor
-  TokenBucket(size_t capacity, double refill_rate_per_sec);
+  explicit MappedFile(const std::string& path);
 
-  // Destructor
-  ~TokenBucket();
+  ~MappedFile();
 
-  TokenBucket(const TokenBucket&) = delete;
-  TokenBucket& operator=(const TokenBucket&) = delete;
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
 
-  // Consume token
-  void consume();
+  bool is_open() const noexcept {
+    return open;
+  }
+
+  std::string_view view() const noexcept {
+    return {data, length};
+  }
 
 private:
-  // Refill bucket
-  void refill();
-
-  size_t capacity;
-  size_t tokens;
-  double refill_rate;
-  bool stop_flag;
-  std::chrono::steady_clock::time_point last_refill;
-  std::mutex bucket_mtx;
-  std::condition_variable cv;
-  std::thread refill_thread;
+  const char* data{nullptr};
+  size_t length{0};
+  bool open{false};
+#ifdef _WIN32
+  std::string contents;
+#endif
 };
 
 class File {
@@ -80,9 +102,9 @@ public:
     return path;
   }
 
-  void append_file_name_to_path(std::string& file_name, std::string& custom_path);
+  void append_file_name_to_path(const std::string& file_name, const std::string& custom_path, std::string_view suffix = "_links.txt");
 
-  bool create_text_file(const std::vector<std::string>& links);
+  bool create_text_file(std::string_view contents);
 
 private:
   std::string path;
@@ -91,6 +113,9 @@ private:
 
 bool remove_file(const std::string& file_path);
 
+// Writes `contents` to a temp file next to `path` in one go and renames it into place, so readers never see a partial file
+bool write_file_atomically(const std::string& path, std::string_view contents);
+
 // struct FileDownloadProgress {
 //   std::string name;
 //   float progress{0.0f};
@@ -98,14 +123,23 @@ bool remove_file(const std::string& file_path);
 
 class FileDownloadProgress {
 public:
-  explicit FileDownloadProgress(const std::string& link, const std::string& name);
+  explicit FileDownloadProgress(const std::string& link, const std::string& name, const nlohmann::json& options = nlohmann::json::object());
 
-  ~FileDownloadProgress();
+  // Tracks a download aria2 already has, e.g. one paused by an earlier run
+  static FileDownloadProgress adopt(std::string gid, std::string link, std::string name, nlohmann::json options);
 
   const std::string& get_name() const noexcept {
     return name;
   }
 
+  const std::string& get_link() const noexcept {
+    return link;
+  }
+
+  const nlohmann::json& get_options() const noexcept {
+    return options;
+  }
+
   float get_progress() const noexcept {
     return progress;
   }
@@ -126,11 +160,33 @@ public:
     completion_status = true;
   }
 
+  // Hoster link the download URL was unrestricted from; empty unless the file was scheduled lazily
+  const std::string& get_source() const noexcept {
+    return source;
+  }
+
+  void set_source(std::string source) {
+    this->source = std::move(source);
+  }
+
+  size_t get_restarts() const noexcept {
+    return restarts;
+  }
+
+  // Swaps a failed aria2 download for one on a fresh URL; the partial file is resumed
+  bool restart(const std::string& link);
+
 private:
+  FileDownloadProgress() = default;
+
   std::optional<std::string> gid;
+  std::string link;
   std::string name;
+  nlohmann::json options;
+  std::string source;
+  size_t restarts{0};
   float progress{0};
-  bool completion_status;
+  bool completion_status{false};
 };
 
 void print_progress_bar(const std::vector<FileDownloadProgress>& files, size_t max_length, size_t bar_width = 40);
@@ -0,0 +1,110 @@
+#include "admission.hpp"
+#include "async.hpp"
+#include "logging.hpp"
+#include "shutdown_handler.hpp"
+#include <algorithm>
+#include <ranges>
+#include <string>
+#include <unordered_set>
+
+namespace {
+
+// Polling starts brisk, since a torrent near the end of caching frees its slot soon, and backs off while nothing moves
+constexpr std::chrono::seconds first_poll_interval{15};
+constexpr std::chrono::seconds max_poll_interval{300};
+
+async::Task<bool> pause(async::EventLoop& loop, std::chrono::steady_clock::duration duration) {
+  co_return co_await loop.sleep_for(duration);
+}
+
+} // namespace
+
+void admission::Controller::enqueue(std::vector<magnet::MagnetLink> magnets) {
+  if (magnets.empty()) {
+    return;
+  }
+  auto hashes = magnets | std::views::transform([](const magnet::MagnetLink& link) { return link.hex_hash(); }) |
+                std::ranges::to<std::vector>();
+  auto available = clients.cached_hashes(hashes);
+  std::unordered_set<std::string> cached(available.begin(), available.end());
+  if (!cached.empty()) {
+    logging::info("admission", "{} of {} torrent(s) are already cached.", cached.size(), magnets.size());
+  }
+
+  std::vector<Entry> entries;
+  entries.reserve(magnets.size());
+  for (size_t i = 0; i < magnets.size(); ++i) {
+    entries.push_back({std::move(magnets[i]), cached.contains(hashes[i])});
+  }
+  std::ranges::move(entries, std::back_inserter(queue));
+  std::ranges::stable_partition(queue, &Entry::cached);
+}
+
+std::vector<api::Torrent> admission::Controller::admit() {
+  std::vector<api::Torrent> admitted;
+  if (queue.empty()) {
+    return admitted;
+  }
+
+  auto counts = clients.active_counts();
+  std::vector<size_t> free_slots(counts.size(), 0);
+  for (size_t account = 0; account < counts.size(); ++account) {
+    // A measured count beats the cooldown left by an earlier "too many active downloads"
+    if (counts[account]) {
+      free_slots[account] = counts[account]->limit > counts[account]->active ? counts[account]->limit - counts[account]->active : 0;
+    } else if (clients.is_available(account)) {
+      // Count unknown: try one, and let the reply tell whether there was room
+      free_slots[account] = 1;
+    }
+  }
+
+  size_t account = 0;
+  while (!queue.empty() && !shutdown_handler::shutdown_requested) {
+    // Cached torrents finish as soon as they are added, so any available account takes them
+    auto& entry = queue.front();
+    while (account < free_slots.size() && free_slots[account] == 0 && !(entry.cached && clients.is_available(account))) {
+      ++account;
+    }
+    if (account == free_slots.size()) {
+      break;
+    }
+
+    auto result = clients.send_magnet_link_to(account, std::string{entry.link.uri});
+    if (result.torrent) {
+      admitted.push_back(std::move(*result.torrent));
+      if (!entry.cached && free_slots[account] > 0) {
+        --free_slots[account];
+      }
+      queue.pop_front();
+    } else if (result.quota) {
+      // The account hit its cap (or some other quota) after all; the magnet stays queued for the next one
+      free_slots[account] = 0;
+      ++account;
+    } else {
+      logging::error("admission", "Could not add {}, skipping it.", entry.link.hex_hash());
+      queue.pop_front();
+    }
+  }
+  return admitted;
+}
+
+std::vector<api::Torrent> admission::Controller::wait_and_admit() {
+  auto interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(first_poll_interval);
+  bool announced = false;
+  async::EventLoop loop;
+  while (!queue.empty() && !shutdown_handler::shutdown_requested) {
+    if (auto admitted = admit(); !admitted.empty()) {
+      return admitted;
+    }
+    if (!announced) {
+      logging::info("admission", "Every account is at its active torrent limit; {} torrent(s) waiting for a free slot...", queue.size());
+      announced = true;
+    }
+    logging::debug("admission", "No free slot, checking again in {}s.", std::chrono::duration_cast<std::chrono::seconds>(interval).count());
+    if (!loop.run(pause(loop, interval))) {
+      break;
+    }
+    interval = std::min<std::chrono::steady_clock::duration>(interval * 3 / 2, max_poll_interval);
+  }
+  return {};
+}
@@ -1,101 +1,211 @@
 #include "api.hpp"
+#include "async.hpp"
+#include "logging.hpp"
 #include "shutdown_handler.hpp"
 #include "util.hpp"
+#include <algorithm>
+#include <charconv>
 #include <chrono>
-#include <cpr/cpr.h>
-#include <iostream>
+#include <format>
+#include <memory>
 #include <nlohmann/json.hpp>
 #include <optional>
-#include <print>
 #include <ranges>
 #include <string>
-#include <thread>
-#include <typeinfo>
 #include <vector>
 
 using json = nlohmann::json;
 
-api::RealDebridClient::RealDebridClient(std::string token) : token{std::move(token)}, bearer{this->token} {}
+namespace {
 
-std::optional<json> api::RealDebridClient::request_json(HTTPMethod method, const std::string& url_suffix, const cpr::Payload& payload) const {
-  cpr::Response response;
+const char* method_name(api::HTTPMethod method) {
   switch (method) {
-  case HTTPMethod::GET:
-    response = cpr::Get(cpr::Url{url + url_suffix}, bearer);
-    break;
-  case HTTPMethod::POST:
-    response = cpr::Post(cpr::Url{url + url_suffix}, bearer, payload);
-    break;
-  case HTTPMethod::PUT:
-    response = cpr::Put(cpr::Url{url + url_suffix}, bearer, payload);
-    break;
-  case HTTPMethod::DELETE:
-    response = cpr::Delete(cpr::Url{url + url_suffix}, bearer);
-    break;
-  }
-
-  if (response.status_code >= 400) {
-    std::cerr << "HTTP error " << response.status_code << ": " << response.error.message << std::endl;
-    return std::nullopt;
+  case api::HTTPMethod::GET:
+    return "GET";
+  case api::HTTPMethod::POST:
+    return "POST";
+  case api::HTTPMethod::PUT:
+    return "PUT";
+  case api::HTTPMethod::DELETE:
+    return "DELETE";
   }
-  if (response.text.empty()) {
+  return "GET";
+}
+
+// Builds a Torrent from a /torrents/info reply, keeping only the selected files
+std::optional<api::Torrent> parse_torrent(const json& parsed_json) {
+  if (!parsed_json.contains("files") || !parsed_json.contains("links")) {
     return std::nullopt;
   }
+  auto selected_files = parsed_json["files"] | std::views::filter([](const json& file) { return file["selected"].get<int>() == 1; });
+  auto files = selected_files | std::views::transform([](const json& file) { return file["path"].get<std::string>(); });
+  auto file_sizes = selected_files | std::views::transform([](const json& file) { return file.value("bytes", std::uint64_t{0}); }) |
+                    std::ranges::to<std::vector>();
+  auto links = parsed_json["links"] | std::views::transform([](const json& link) { return link.get<std::string>(); });
+  std::string torrent_name =
+      parsed_json.contains("filename") && parsed_json["filename"].is_string() ? parsed_json["filename"].get<std::string>() : "Unknown filename";
+  std::vector<std::string> file_names = files | std::ranges::views::transform([](const std::string& file) {
+                                          auto position = file.substr(1).find('/');
+                                          return position != std::string::npos ? file.substr(position + 2) : file.substr(1);
+                                        }) |
+                                        std::ranges::to<std::vector>();
+  auto size = parsed_json.contains("original_bytes") ? parsed_json["original_bytes"].get<std::uint64_t>() : 0;
+  return api::Torrent{parsed_json.value("id", std::string{}), torrent_name, file_names, file_sizes,
+                      std::vector<std::string>{links.begin(), links.end()}, size};
+}
+
+// How long an account sits out after an error; zero for errors that are not about the account
+std::chrono::steady_clock::duration cooldown_for(long status_code, int error_code) {
+  switch (error_code) {
+  case 5:  // slow down
+  case 34: // too many requests
+    return std::chrono::minutes(1);
+  case 21: // too many active downloads
+  case 23: // traffic exhausted
+  case 36: // fair usage limit
+    return std::chrono::minutes(30);
+  case 8:  // bad token
+  case 9:  // permission denied
+  case 14: // account locked
+  case 15: // account not activated
+  case 20: // premium only
+    return std::chrono::hours(24);
+  default:
+    return status_code == 429 ? std::chrono::minutes(1) : std::chrono::steady_clock::duration::zero();
+  }
+}
+
+} // namespace
+
+api::RealDebridClient::RealDebridClient(std::string token) : token{std::move(token)}, limiter{std::make_unique<async::RateLimiter>(4, 4)} {}
+
+bool api::RealDebridClient::is_available() const noexcept {
+  return std::chrono::steady_clock::now() >= cooldown_until;
+}
+
+bool api::RealDebridClient::record_error(long status_code, const json& error) const {
+  int error_code = error.is_object() ? error.value("error_code", 0) : 0;
+  if (auto cooldown = cooldown_for(status_code, error_code); cooldown > std::chrono::steady_clock::duration::zero()) {
+    cooldown_until = std::max(cooldown_until, std::chrono::steady_clock::now() + cooldown);
+    return true;
+  }
+  return false;
+}
+
+bool api::RealDebridClient::handle_error(const async::HttpResponse& response, bool report) const {
+  if (report) {
+    logging::error("api", "HTTP error {}: {}", response.status_code, response.text);
+  }
+  return record_error(response.status_code, json::parse(response.text, nullptr, false));
+}
+
+async::Task<std::optional<async::HttpResponse>> api::RealDebridClient::fetch_async(async::EventLoop& loop, HTTPMethod method, std::string url_suffix,
+                                                                                  async::Form form) const {
+  async::HttpRequest request;
+  request.method = method_name(method);
+  request.url = url + url_suffix;
+  request.headers.push_back("Authorization: Bearer " + token);
+  request.body = async::form_encode(form);
+
+  if (!co_await limiter->acquire(loop)) {
+    co_return std::nullopt;
+  }
+  auto response = co_await loop.fetch(std::move(request));
+
+  if (response.cancelled) {
+    co_return std::nullopt;
+  }
+  if (!response.error.empty()) {
+    logging::error("api", "Request error: {}", response.error);
+    co_return std::nullopt;
+  }
+  co_return response;
+}
+
+async::Task<std::optional<async::HttpResponse>> api::RealDebridClient::send_request_async(async::EventLoop& loop, HTTPMethod method,
+                                                                                         std::string url_suffix, async::Form form,
+                                                                                         bool report_errors) const {
+  auto response = co_await fetch_async(loop, method, std::move(url_suffix), std::move(form));
+  if (!response) {
+    co_return std::nullopt;
+  }
+  if (response->status_code >= 400) {
+    handle_error(*response, report_errors);
+    co_return std::nullopt;
+  }
+  co_return response;
+}
+
+async::Task<std::optional<json>> api::RealDebridClient::request_json_async(async::EventLoop& loop, HTTPMethod method, std::string url_suffix,
+                                                                            async::Form form) const {
+  auto response = co_await send_request_async(loop, method, std::move(url_suffix), std::move(form));
+  if (!response || response->text.empty()) {
+    co_return std::nullopt;
+  }
 
   json parsed_response;
   try {
-    parsed_response = json::parse(response.text);
+    parsed_response = json::parse(response->text);
   } catch (const json::parse_error& e) {
-    std::cerr << "JSON parse error: " << e.what() << std::endl;
-    return std::nullopt;
+    logging::error("api", "JSON parse error: {}", e.what());
+    co_return std::nullopt;
   }
-  if (parsed_response.contains("error")) {
-    std::cerr << "API error: " << parsed_response["error"].get<std::string>() << std::endl;
-    return std::nullopt;
+  if (parsed_response.is_object() && parsed_response.contains("error")) {
+    logging::error("api", "API error: {}", parsed_response["error"].get<std::string>());
+    record_error(response->status_code, parsed_response);
+    co_return std::nullopt;
   }
-  return parsed_response;
+  co_return parsed_response;
 }
 
-std::optional<api::Torrent> api::RealDebridClient::send_magnet_link(const std::string& magnet) const {
-  std::println("Sending magnet link to Real-Debrid for caching...");
-  if (auto parsed_response = request_json(HTTPMethod::POST, "/torrents/addMagnet", cpr::Payload{{"magnet", magnet}})) {
-    std::string generated_id = (*parsed_response)["id"].get<std::string>();
-    std::println("Successfully sent! Generated ID: {}", generated_id);
-    if (auto parsed_response = request_json(HTTPMethod::GET, "/torrents/info/" + generated_id)) {
-      auto& parsed_json = (*parsed_response);
-      if (parsed_json.contains("status") && parsed_json["status"].is_string() && wait_for_status(generated_id, "waiting_files_selection")) {
-        std::this_thread::sleep_for(post_delay);
-
-        // Select all files and start download
-        request_json(HTTPMethod::POST, "/torrents/selectFiles/" + generated_id, cpr::Payload{{"files", "all"}});
-        std::this_thread::sleep_for(post_delay);
-        // Get updated torrent info
-        if (auto parsed_response = request_json(HTTPMethod::GET, "/torrents/info/" + generated_id)) {
-          auto& parsed_json = (*parsed_response);
-          if (parsed_json.contains("files") && parsed_json.contains("links")) {
-            auto files = parsed_json["files"] | std::views::filter([](const json& file) { return file["selected"].get<int>() == 1; }) |
-                         std::views::transform([](const json& file) { return file["path"].get<std::string>(); });
-            auto links = parsed_json["links"] | std::views::transform([](const json& link) { return link.get<std::string>(); });
-            std::string torrent_name = parsed_json.contains("filename") && parsed_json["filename"].is_string()
-                                           ? parsed_json["filename"].get<std::string>()
-                                           : "Unknown filename";
-            std::vector<std::string> file_names = files | std::ranges::views::transform([](const std::string& file) {
-                                                    auto position = file.substr(1).find('/');
-                                                    return position != std::string::npos ? file.substr(position + 2) : file;
-                                                  }) |
-                                                  std::ranges::to<std::vector>();
-            auto size = parsed_json.contains("original_bytes") ? parsed_json["original_bytes"].get<int>() : 0;
-            api::Torrent torrent{generated_id, torrent_name, file_names, std::vector<std::string>{links.begin(), links.end()}, size};
-            return torrent;
-          }
+async::Task<api::AddResult> api::RealDebridClient::send_magnet_link_async(async::EventLoop& loop, std::string magnet) const {
+  logging::info("api", "Sending magnet link to Real-Debrid for caching...");
+  async::Form payload{{"magnet", std::move(magnet)}};
+  auto added = co_await fetch_async(loop, HTTPMethod::POST, "/torrents/addMagnet", std::move(payload));
+  if (!added) {
+    co_return AddResult{};
+  }
+  if (added->status_code >= 400) {
+    co_return AddResult{std::nullopt, handle_error(*added, true)};
+  }
+  auto added_json = json::parse(added->text, nullptr, false);
+  if (!added_json.is_object() || !added_json["id"].is_string()) {
+    logging::error("api", "Unexpected addMagnet response: {}", added->text);
+    co_return AddResult{};
+  }
+  std::string generated_id = added_json["id"].get<std::string>();
+  logging::info("api", "Successfully sent! Generated ID: {}", generated_id);
+
+  AddResult result;
+  if (co_await wait_for_status_async(loop, generated_id, "waiting_files_selection")) {
+    co_await loop.sleep_for(post_delay);
+
+    // Select all files and start download; this is where Real-Debrid enforces the active torrent limit
+    async::Form selection{{"files", "all"}};
+    auto selected = co_await fetch_async(loop, HTTPMethod::POST, "/torrents/selectFiles/" + generated_id, std::move(selection));
+    if (selected && selected->status_code >= 400) {
+      result.quota = handle_error(*selected, true);
+    } else if (selected) {
+      co_await loop.sleep_for(post_delay);
+      // Get updated torrent info
+      if (auto parsed_response = co_await request_json_async(loop, HTTPMethod::GET, "/torrents/info/" + generated_id)) {
+        if (auto torrent = parse_torrent(*parsed_response)) {
+          torrent->id = generated_id;
+          result.torrent = std::move(torrent);
+          co_return result;
         }
       }
     }
   }
-  return std::nullopt;
+  // Leave nothing half-added behind, as the caller may well add it again on another account
+  if (!loop.is_cancelled()) {
+    co_await send_request_async(loop, HTTPMethod::DELETE, "/torrents/delete/" + generated_id);
+  }
+  co_return result;
 }
 
-bool api::RealDebridClient::wait_for_status(const std::string& torrent_id, const std::string& desired_status, int torrent_size) const {
+async::Task<bool> api::RealDebridClient::wait_for_status_async(async::EventLoop& loop, std::string torrent_id, std::string desired_status,
+                                                               std::uint64_t torrent_size) const {
   int max_retries, initial_interval;
   if (torrent_size < 500 * 1024 * 1024) { // < 500MB
     max_retries = 30;                     // ~2.5 min
@@ -116,78 +226,265 @@ bool api::RealDebridClient::wait_for_status(const std::string& torrent_id, const
     }
     if (i % 60 == 0) {
       if (i == 0) {
-        std::println("Waiting for status: {}...", desired_status);
+        logging::info("api", "Waiting for status: {}...", desired_status);
       } else {
-        std::println("Still waiting for status: {}...", desired_status);
+        logging::info("api", "Still waiting for status: {}...", desired_status);
       }
     }
-    if (auto parsed_response = request_json(HTTPMethod::GET, "/torrents/info/" + torrent_id)) {
+    if (auto parsed_response = co_await request_json_async(loop, HTTPMethod::GET, "/torrents/info/" + torrent_id)) {
       auto& parsed_json = (*parsed_response);
       std::string status =
           parsed_json.contains("status") && parsed_json["status"].is_string() ? parsed_json["status"].get<std::string>() : "status unknown";
 
       if (status == desired_status)
-        return true;
+        co_return true;
 
       if (status == "error" || status == "magnet_error" || status == "virus" || status == "downloaded") {
-        std::println("Torrent {} ended with status: {}", torrent_id, status);
-        return false;
+        logging::warn("api", "Torrent {} ended with status: {}", torrent_id, status);
+        co_return false;
       }
     } else {
-      return false;
+      co_return false;
     }
 
-    std::this_thread::sleep_for(static_cast<std::chrono::seconds>(interval));
+    // Timers instead of sleeping the thread; a cancelled loop cuts the wait short
+    if (!co_await loop.sleep_for(std::chrono::seconds(interval))) {
+      break;
+    }
     if (interval < max_interval) {
       interval = std::min(static_cast<int>(interval * 1.2), max_interval);
     }
   }
-  std::println("", desired_status);
-  return false;
+  co_return false;
 }
 
-std::vector<std::string> api::RealDebridClient::get_download_links(const std::vector<std::string>& links) {
-  std::mutex print_mutex;
-  std::vector<std::string> unrestricted_download_links;
-  unrestricted_download_links.reserve(links.size());
+async::Task<std::optional<std::string>> api::RealDebridClient::unrestrict_async(async::EventLoop& loop, std::string link) const {
+  async::Form payload{{"link", link}};
+  if (auto parsed_response = co_await request_json_async(loop, HTTPMethod::POST, "/unrestrict/link", std::move(payload))) {
+    auto& parsed_json = (*parsed_response);
+    if (parsed_json.contains("download") && parsed_json["download"].is_string()) {
+      co_return parsed_json["download"].get<std::string>();
+    }
+    logging::error("api", "Unexpected response format for link: {}", link);
+  } else if (!loop.is_cancelled()) {
+    logging::error("api", "Failed to unrestrict link: {}", link);
+  }
+  co_return std::nullopt;
+}
 
-  // API restricted to 250 requests per minute
-  util::TokenBucket bucket(4, 4);
+async::Task<api::LinkCheck> api::RealDebridClient::check_link_async(async::EventLoop& loop, std::string link) const {
+  async::Form payload{{"link", link}};
+  auto response = co_await fetch_async(loop, HTTPMethod::POST, "/unrestrict/check", std::move(payload));
+  if (!response) {
+    co_return LinkCheck{};
+  }
+  // 503 is Real-Debrid's "file unavailable", an expected outcome here; any other error says nothing about the link
+  if (response->status_code == 503) {
+    co_return LinkCheck{std::nullopt, true};
+  }
+  auto parsed_json = json::parse(response->text, nullptr, false);
+  if (response->status_code >= 400) {
+    record_error(response->status_code, parsed_json);
+    co_return LinkCheck{};
+  }
+  if (!parsed_json.is_object()) {
+    co_return LinkCheck{};
+  }
+  if (parsed_json.value("supported", 0) != 1) {
+    co_return LinkCheck{std::nullopt, true};
+  }
+  co_return LinkCheck{LinkInfo{std::move(link), parsed_json.value("host", std::string{}), parsed_json.value("filename", std::string{}),
+                     parsed_json.value("filesize", std::uint64_t{0})}};
+}
 
-  std::vector<std::future<std::optional<std::string>>> futures;
+async::Task<std::vector<std::optional<std::string>>> api::RealDebridClient::get_download_links_async(async::EventLoop& loop,
+                                                                                                    std::vector<std::string> links) const {
+  // All started at once; the rate limiter in send_request_async spaces them out
+  std::vector<async::Task<std::optional<std::string>>> tasks;
+  tasks.reserve(links.size());
+  for (auto& link : links) {
+    tasks.push_back(unrestrict_async(loop, std::move(link)));
+  }
+  co_return co_await async::gather(std::move(tasks));
+}
 
-  for (const auto& link : links) {
-    futures.push_back(std::async(std::launch::async, [&] {
-      bucket.consume();
-
-      if (auto parsed_response = request_json(HTTPMethod::POST, "/unrestrict/link", cpr::Payload{{"link", link}})) {
-        auto& parsed_json = (*parsed_response);
-        if (parsed_json.contains("download") && parsed_json["download"].is_string()) {
-          std::string download_link = parsed_json["download"];
-          {
-            std::scoped_lock lock(print_mutex);
-            // std::println("Unrestricted counterpart: {}", download_link);
-          }
-          return std::optional<std::string>{std::move(download_link)};
-        } else {
-          std::println("Unexpected response format for link: {}", link);
-        }
-      } else {
-        std::println("Failed to unrestrict link: {}", link);
-      }
-      return std::optional<std::string>{};
-    }));
+async::Task<std::optional<api::ActiveCount>> api::RealDebridClient::active_count_async(async::EventLoop& loop) const {
+  auto parsed_response = co_await request_json_async(loop, HTTPMethod::GET, "/torrents/activeCount");
+  if (!parsed_response || !(*parsed_response)["nb"].is_number_unsigned() || !(*parsed_response)["limit"].is_number_unsigned()) {
+    co_return std::nullopt;
+  }
+  co_return ActiveCount{(*parsed_response)["nb"].get<size_t>(), (*parsed_response)["limit"].get<size_t>()};
+}
 
-    if (shutdown_handler::shutdown_requested) {
+async::Task<std::optional<std::vector<std::string>>> api::RealDebridClient::instant_availability_async(async::EventLoop& loop,
+                                                                                                     std::vector<std::string> hashes) const {
+  std::string url_suffix{"/torrents/instantAvailability"};
+  for (const auto& hash : hashes) {
+    url_suffix += "/" + hash;
+  }
+  // Real-Debrid may have the endpoint switched off, which is not worth an error message
+  auto response = co_await send_request_async(loop, HTTPMethod::GET, std::move(url_suffix), {}, false);
+  if (!response) {
+    co_return std::nullopt;
+  }
+  auto parsed_json = json::parse(response->text, nullptr, false);
+  if (!parsed_json.is_object()) {
+    co_return std::nullopt;
+  }
+  // A cached hash maps to {"rd": [variants...]}, anything else to an empty array or object
+  std::vector<std::string> cached;
+  for (const auto& hash : hashes) {
+    if (auto entry = parsed_json.find(hash);
+        entry != parsed_json.end() && entry->is_object() && (*entry)["rd"].is_array() && !(*entry)["rd"].empty()) {
+      cached.push_back(hash);
+    }
+  }
+  co_return cached;
+}
+
+async::Task<std::optional<api::Page>> api::RealDebridClient::list_async(async::EventLoop& loop, std::string endpoint, std::uint64_t offset,
+                                                                        std::uint64_t limit) const {
+  auto response = co_await send_request_async(loop, HTTPMethod::GET, std::format("{}?offset={}&limit={}", endpoint, offset, limit));
+  if (!response) {
+    co_return std::nullopt;
+  }
+
+  Page page{json::array(), 0};
+  if (auto header = response->headers.find("x-total-count"); header != response->headers.end()) {
+    std::from_chars(header->second.data(), header->second.data() + header->second.size(), page.total_count);
+  }
+  // An empty list comes back as 204 without a body
+  if (!response->text.empty()) {
+    try {
+      page.items = json::parse(response->text);
+    } catch (const json::parse_error& e) {
+      logging::error("api", "JSON parse error: {}", e.what());
+      co_return std::nullopt;
+    }
+  }
+  if (!page.items.is_array()) {
+    co_return std::nullopt;
+  }
+  co_return page;
+}
+
+api::AddResult api::RealDebridClient::send_magnet_link(const std::string& magnet) const {
+  async::EventLoop loop;
+  return loop.run(send_magnet_link_async(loop, magnet));
+}
+
+bool api::RealDebridClient::wait_for_status(const std::string& torrent_id, const std::string& desired_status, std::uint64_t torrent_size) const {
+  async::EventLoop loop;
+  return loop.run(wait_for_status_async(loop, torrent_id, desired_status, torrent_size));
+}
+
+std::vector<std::optional<std::string>> api::RealDebridClient::get_download_links(const std::vector<std::string>& links) {
+  async::EventLoop loop;
+  return loop.run(get_download_links_async(loop, links));
+}
+
+api::ClientPool::ClientPool(const std::vector<std::string>& tokens) {
+  if (tokens.empty()) {
+    util::fatal_error("No API token given.");
+  }
+  clients.reserve(tokens.size());
+  for (const auto& token : tokens) {
+    clients.emplace_back(token);
+  }
+}
+
+const api::RealDebridClient& api::ClientPool::owner_of(const std::string& torrent_id) const {
+  auto it = torrent_owners.find(torrent_id);
+  return it != torrent_owners.end() ? clients[it->second] : primary();
+}
+
+api::AddResult api::ClientPool::send_magnet_link_to(size_t account, const std::string& magnet) {
+  auto result = clients[account].send_magnet_link(magnet);
+  if (result.torrent) {
+    torrent_owners.insert_or_assign(result.torrent->id, account);
+  }
+  return result;
+}
+
+std::vector<std::optional<api::ActiveCount>> api::ClientPool::active_counts() const {
+  async::EventLoop loop;
+  std::vector<async::Task<std::optional<ActiveCount>>> tasks;
+  tasks.reserve(clients.size());
+  for (const auto& client : clients) {
+    tasks.push_back(client.active_count_async(loop));
+  }
+  return loop.run(async::gather(std::move(tasks)));
+}
+
+std::vector<std::string> api::ClientPool::cached_hashes(const std::vector<std::string>& hashes) const {
+  // Batches keep the URL short; they go out one at a time so an endpoint that is switched off costs a single request
+  constexpr size_t batch_size = 40;
+  std::vector<std::string> cached;
+  async::EventLoop loop;
+  for (size_t begin = 0; begin < hashes.size(); begin += batch_size) {
+    std::vector<std::string> batch{hashes.begin() + static_cast<std::ptrdiff_t>(begin),
+                                   hashes.begin() + static_cast<std::ptrdiff_t>(std::min(begin + batch_size, hashes.size()))};
+    auto available = loop.run(primary().instant_availability_async(loop, std::move(batch)));
+    if (!available) {
       break;
     }
+    std::ranges::move(*available, std::back_inserter(cached));
   }
+  return cached;
+}
 
-  for (auto& future : futures) {
-    if (auto link = future.get()) {
-      unrestricted_download_links.emplace_back(std::move(*link));
+bool api::ClientPool::wait_for_status(const std::string& torrent_id, const std::string& desired_status, std::uint64_t torrent_size) const {
+  return owner_of(torrent_id).wait_for_status(torrent_id, desired_status, torrent_size);
+}
+
+std::vector<std::optional<std::string>> api::ClientPool::get_download_links(const std::vector<std::string>& links) {
+  async::EventLoop loop;
+  std::vector<async::Task<std::optional<std::string>>> tasks;
+  tasks.reserve(links.size());
+  for (const auto& link : links) {
+    tasks.push_back(unrestrict_async(loop, link));
+  }
+  return loop.run(async::gather(std::move(tasks)));
+}
+
+std::vector<api::LinkCheck> api::ClientPool::check_links(const std::vector<std::string>& links) {
+  // Round robin, like the unrestrict calls
+  async::EventLoop loop;
+  std::vector<async::Task<LinkCheck>> tasks;
+  tasks.reserve(links.size());
+  for (size_t i = 0; i < links.size(); ++i) {
+    tasks.push_back(check_link_async(loop, links[i], i % clients.size()));
+  }
+  return loop.run(async::gather(std::move(tasks)));
+}
+
+async::Task<api::LinkCheck> api::ClientPool::check_link_async(async::EventLoop& loop, std::string link, size_t first_account) const {
+  for (size_t attempt = 0; attempt < clients.size(); ++attempt) {
+    auto& client = clients[(first_account + attempt) % clients.size()];
+    if (!client.is_available()) {
+      continue;
+    }
+    auto check = co_await client.check_link_async(loop, link);
+    if (check.info || check.dead || loop.is_cancelled()) {
+      co_return check;
     }
   }
+  co_return LinkCheck{};
+}
 
-  return unrestricted_download_links;
+async::Task<std::optional<std::string>> api::ClientPool::unrestrict_async(async::EventLoop& loop, std::string link) {
+  // Round robin, so each account's own rate limiter only carries its share of the links
+  for (size_t attempt = 0; attempt < clients.size(); ++attempt) {
+    auto& client = clients[next_unrestrict++ % clients.size()];
+    if (!client.is_available()) {
+      continue;
+    }
+    if (auto unrestricted = co_await client.unrestrict_async(loop, link)) {
+      co_return unrestricted;
+    }
+    if (client.is_available() || loop.is_cancelled()) {
+      break;
+    }
+  }
+  co_return std::nullopt;
 }
@@ -1,9 +1,13 @@
 #include "aria2_manager.hpp"
+#include "logging.hpp"
 #include "util.hpp"
+#include <algorithm>
 #include <chrono>
 #include <cpr/cpr.h>
-#include <iostream>
+#include <filesystem>
+#include <format>
 #include <nlohmann/json.hpp>
+#include <numeric>
 #include <print>
 #include <sstream>
 #include <stdexcept>
@@ -14,156 +18,387 @@
 #ifdef _WIN32
 #include <windows.h>
 #else
+#include <spawn.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
+
+extern char** environ;
 #endif
 
 using json = nlohmann::json;
 
-void aria2::launch_aria2_handoff(const std::string& links_file) {
-  if (links_file.empty()) {
-    std::cerr << "[aria2] No URLs provided.\n";
+namespace {
+
+constexpr std::uint64_t MiB = 1024ULL * 1024;
+constexpr std::uint64_t GiB = 1024 * MiB;
+
+std::string rpc_url{"http://localhost:6800/jsonrpc"};
+const std::string rpc_token{"token:nuclearlaunchcode"};
+
+// Posts a JSON-RPC payload as is, returns the whole reply
+std::optional<json> rpc_post(const json& payload) {
+  cpr::Response response = cpr::Post(cpr::Url{rpc_url}, cpr::Body{payload.dump()}, cpr::Header{{"Content-Type", "application/json"}});
+
+  if (response.status_code == 200) {
+    try {
+      return json::parse(response.text);
+    } catch (const json::parse_error& e) {
+      logging::error("aria2", "JSON parse error: {}", e.what());
+    }
   }
+  return std::nullopt;
+}
 
-#ifdef _WIN32
-  // Build the aria2c command
-  std::ostringstream cmd;
-  cmd << "aria2c -i "
-         " << links_file << -d ./Downloads -x 16 - s16 --continue=true --max-connection-per-server=4";
-  std::string command = cmd.str();
-
-  // On Windows: use CreateProcess to avoid blocking
-  STARTUPINFOA si{};
-  PROCESS_INFORMATION pi{};
-  si.cb = sizeof(si);
-
-  // Start the child process
-  if (!CreateProcessA(nullptr,            // No module name (use command line)
-                     command.data(),      // Command line, mutable C-string
-                     nullptr,             // Process handle not inheritable
-                     nullptr,             // Thread handle not inheritable
-                     FALSE,               // Set handle inheritance to FALSE
-                     CREATE_NEW_CONSOLE,  // Creation flags
-                     nullptr,             // Use parent's environment block
-                     nullptr,             // Use parent's starting directory
-                     &si,                 // Pointer to STARTUPINFO structure
-                     &pi)                 // Pointer to PROCESS_INFORMATION structure) 
-  {
-    util::fatal_exit("[aria2] Failed to launch process. Error: " + static_cast<std::string>(GetLastError()) + "\n");
-    return;
-  }
-
-  // aria2c runs independently
-  CloseHandle(pi.hProcess);
-  CloseHandle(pi.hThread);
-#else
-  // On Linux/macOS: fork + exec
-  pid_t pid = fork();
-  if (pid == 0) {
-    // Child process: detach from terminal
-    if (setsid() < 0) {
-      _exit(1); // exec failed
+// Sends a single JSON-RPC call with the secret prepended to params, returns the whole reply
+std::optional<json> rpc_request(const std::string& method, json params = json::array()) {
+  params.insert(params.begin(), rpc_token);
+  return rpc_post({{"jsonrpc", "2.0"}, {"id", "JID"}, {"method", method}, {"params", std::move(params)}});
+}
+
+// Runs `method` once per GID (followed by `argument`, if any) in a single system.multicall round trip; each result is [value] or a fault object
+std::optional<json> rpc_multicall(const std::string& method, const std::vector<std::string>& gids, const json& argument = nullptr) {
+  json calls = json::array();
+  for (const auto& gid : gids) {
+    json params = json::array({rpc_token, gid});
+    if (!argument.is_null()) {
+      params.push_back(argument);
     }
+    calls.push_back({{"methodName", method}, {"params", std::move(params)}});
+  }
+  auto parsed_json = rpc_post({{"jsonrpc", "2.0"}, {"id", "JID"}, {"method", "system.multicall"}, {"params", json::array({calls})}});
+  if (!parsed_json || !parsed_json->contains("result") || !(*parsed_json)["result"].is_array()) {
+    return std::nullopt;
+  }
+  return (*parsed_json)["result"];
+}
 
-    // Prepare arguments
-    char* args[] = {(char*)"aria2c", (char*)"-i",    (char*)links_file.c_str(), (char*)"-d ./Downloads",
-                    (char*)"-x 16",  (char*)"-s 16", (char*)"--continue=true",  (char*)"--max-connection-per-server=4",
-                    nullptr};
+// The tellStatus fields the monitor and the session snapshot read
+json status_keys() {
+  return json::array({"status", "totalLength", "completedLength", "downloadSpeed", "connections", "errorCode"});
+}
 
-    execvp("aria2c", args);
-    // If execvp returns, there was an error
-    _exit(1); // exec failed
-  } else if (pid < 0) {
-    util::fatal_exit("[aria2] Failed to fork process.");
+#ifndef _WIN32
+// Starts a process in its own session without going through a shell
+std::optional<pid_t> spawn_process(const std::vector<std::string>& args) {
+  std::vector<char*> argv;
+  argv.reserve(args.size() + 1);
+  for (const auto& arg : args) {
+    argv.push_back(const_cast<char*>(arg.c_str()));
   }
-  // aria2c runs independently
+  argv.push_back(nullptr);
+
+  posix_spawnattr_t attributes;
+  posix_spawnattr_init(&attributes);
+#ifdef POSIX_SPAWN_SETSID
+  posix_spawnattr_setflags(&attributes, static_cast<short>(POSIX_SPAWN_SETSID));
+#endif
+  pid_t pid;
+  int result = posix_spawnp(&pid, argv.front(), nullptr, &attributes, argv.data(), environ);
+  posix_spawnattr_destroy(&attributes);
+
+  if (result != 0) {
+    return std::nullopt;
+  }
+  return pid;
+}
+#else
+// Joins arguments into a single command line, quoting the ones containing spaces
+std::string join_command_line(const std::vector<std::string>& args) {
+  std::string command;
+  for (const auto& arg : args) {
+    if (!command.empty()) {
+      command += ' ';
+    }
+    command += arg.find(' ') != std::string::npos ? '"' + arg + '"' : arg;
+  }
+  return command;
+}
 #endif
+
+} // namespace
+
+std::vector<std::string> aria2::TuningProfile::to_arguments() const {
+  return {
+      std::format("--split={}", split),
+      std::format("--max-connection-per-server={}", max_connection_per_server),
+      std::format("--min-split-size={}M", min_split_size / MiB),
+      std::format("--disk-cache={}M", disk_cache / MiB),
+      std::format("--file-allocation={}", file_allocation),
+      std::format("--max-concurrent-downloads={}", max_concurrent_downloads),
+  };
+}
+
+json aria2::TuningProfile::to_options() const {
+  // disk-cache can only be set at startup, so it is left out here
+  return {
+      {"split", std::to_string(split)},
+      {"max-connection-per-server", std::to_string(max_connection_per_server)},
+      {"min-split-size", std::format("{}M", min_split_size / MiB)},
+      {"file-allocation", file_allocation},
+      {"max-concurrent-downloads", std::to_string(max_concurrent_downloads)},
+  };
+}
+
+aria2::TuningProfile aria2::derive_tuning_profile(size_t download_count, const std::vector<std::uint64_t>& file_sizes) {
+  TuningProfile profile;
+
+  // Many files are best served by running them side by side rather than by deep segmenting
+  profile.max_concurrent_downloads = std::clamp<size_t>(download_count, 1, 8);
+
+  if (file_sizes.empty()) {
+    return profile;
+  }
+
+  const std::uint64_t largest = std::ranges::max(file_sizes);
+  const std::uint64_t total = std::accumulate(file_sizes.begin(), file_sizes.end(), std::uint64_t{0});
+
+  size_t split;
+  if (largest >= 4 * GiB) {
+    split = 16;
+  } else if (largest >= GiB) {
+    split = 12;
+  } else if (largest >= 200 * MiB) {
+    split = 8;
+  } else if (largest >= 20 * MiB) {
+    split = 4;
+  } else {
+    split = 1;
+  }
+  // Keep the total connection count bounded once several downloads run at once
+  split = std::clamp<size_t>(32 / profile.max_concurrent_downloads, 1, split);
+
+  profile.split = split;
+  profile.max_connection_per_server = std::min<size_t>(split, 16); // aria2 hard limit
+  profile.min_split_size = std::clamp<std::uint64_t>(largest / split / MiB * MiB, MiB, 64 * MiB);
+
+  if (total >= 10 * GiB) {
+    profile.disk_cache = 128 * MiB;
+  } else if (total >= GiB) {
+    profile.disk_cache = 64 * MiB;
+  }
+
+  return profile;
 }
 
 bool aria2::is_rpc_running() {
   try {
-    json payload = {{"jsonrpc", "2.0"}, {"id", "ping"}, {"method", "aria2.getVersion"}, {"params", {"token:nuclearlaunchcode"}}};
+    json payload = {{"jsonrpc", "2.0"}, {"id", "ping"}, {"method", "aria2.getVersion"}, {"params", {rpc_token}}};
 
-    cpr::Response response =
-        cpr::Post(cpr::Url{"http://localhost:6800/jsonrpc"}, cpr::Body{payload.dump()}, cpr::Header{{"Content-Type", "application/json"}});
+    cpr::Response response = cpr::Post(cpr::Url{rpc_url}, cpr::Body{payload.dump()}, cpr::Header{{"Content-Type", "application/json"}},
+                                       cpr::Timeout{std::chrono::milliseconds(500)});
 
     if (response.status_code == 200) {
       auto parsed_json = json::parse(response.text);
       return parsed_json.contains("result"); // valid RPC reply
     }
   } catch (const std::exception& e) {
-    std::cerr << "[aria2] RPC check failed: " << e.what() << "\n";
+    logging::debug("aria2", "RPC check failed: {}", e.what());
   }
   return false;
 }
 
-bool aria2::launch_aria2_daemon() {
-  std::string cmd = "aria2c --enable-rpc --rpc-secret=nuclearlaunchcode --rpc-listen-all=true --daemon=true";
-
+bool aria2::launch_aria2_daemon(const TuningProfile& profile, std::chrono::milliseconds timeout) {
   if (is_rpc_running()) {
+    // Reuse the running daemon, but make new downloads pick up this profile
+    rpc_change_global_option(profile.to_options());
     return true;
   }
 
-  std::system(cmd.c_str());
+  std::vector<std::string> args{"aria2c", "--enable-rpc", "--rpc-secret=nuclearlaunchcode", "--rpc-listen-all=true", "--daemon=true"};
+  std::ranges::move(profile.to_arguments(), std::back_inserter(args));
 
-  // Retry a few times until RPC is responsive
-  for (size_t i = 0; i < 5; ++i) {
-    std::this_thread::sleep_for(std::chrono::seconds(2));
+  // Paused downloads survive in the session file, and come back (with their GIDs) if the daemon had to be restarted
+  std::error_code error;
+  std::filesystem::create_directories(download_dir, error);
+  auto session_path = std::filesystem::absolute(session_file).string();
+  args.push_back("--save-session=" + session_path);
+  if (std::filesystem::exists(session_path, error)) {
+    args.push_back("--input-file=" + session_path);
+  }
+
+#ifdef _WIN32
+  std::system(join_command_line(args).c_str());
+#else
+  if (auto pid = spawn_process(args)) {
+    // With --daemon=true the spawned process forks and exits right away
+    waitpid(*pid, nullptr, 0);
+  } else {
+    logging::error("aria2", "Failed to launch process.");
+    return false;
+  }
+#endif
+
+  // Poll until RPC is responsive, backing off from 5ms up to 100ms
+  auto deadline = std::chrono::steady_clock::now() + timeout;
+  std::chrono::milliseconds interval{5};
+  while (std::chrono::steady_clock::now() < deadline) {
     if (is_rpc_running()) {
       return true;
     }
+    std::this_thread::sleep_for(interval);
+    interval = std::min(interval * 2, std::chrono::milliseconds(100));
   }
 
+  return is_rpc_running();
+}
+
+bool aria2::rpc_change_global_option(const json& options) {
+  if (auto parsed_json = rpc_request("aria2.changeGlobalOption", json::array({options}))) {
+    return parsed_json->contains("result") && (*parsed_json)["result"] == "OK";
+  }
   return false;
 }
 
-std::optional<std::string> aria2::rpc_add_download(const std::string& link) {
-  json payload = {{"jsonrpc", "2.0"}, {"id", "JID"}, {"method", "aria2.addUri"}, {"params", {"token:nuclearlaunchcode", json::array({link})}}};
+size_t aria2::rpc_change_options(const std::vector<std::string>& gids, const json& options) {
+  if (gids.empty()) {
+    return 0;
+  }
+  auto results = rpc_multicall("aria2.changeOption", gids, options);
+  if (!results) {
+    return 0;
+  }
+  return static_cast<size_t>(std::ranges::count_if(*results, [](const json& result) { return result.is_array(); }));
+}
 
-  cpr::Response response =
-      cpr::Post(cpr::Url{"http://localhost:6800/jsonrpc"}, cpr::Body{payload.dump()}, cpr::Header{{"Content-Type", "application/json"}});
+std::optional<aria2::GlobalStat> aria2::rpc_get_global_stat() {
+  auto parsed_json = rpc_request("aria2.getGlobalStat");
+  if (!parsed_json || !parsed_json->contains("result")) {
+    return std::nullopt;
+  }
+  // aria2 sends every number as a string
+  const auto& result = (*parsed_json)["result"];
+  try {
+    return GlobalStat{std::stoull(result.value("downloadSpeed", "0")), std::stoul(result.value("numActive", "0")),
+                      std::stoul(result.value("numWaiting", "0"))};
+  } catch (const std::exception& e) {
+    logging::warn("aria2", "Unexpected global stat: {}", e.what());
+    return std::nullopt;
+  }
+}
 
-  if (response.status_code == 200) {
-    auto parsed_json = json::parse(response.text);
-    if (parsed_json.contains("result")) {
+std::optional<std::string> aria2::rpc_add_download(const std::string& link, const json& options) {
+  if (auto parsed_json = rpc_request("aria2.addUri", json::array({json::array({link}), options}))) {
+    if (parsed_json->contains("result")) {
       // std::println("GID: {}", parsed_json["result"].get<std::string>());
-      return parsed_json["result"].get<std::string>();
+      return (*parsed_json)["result"].get<std::string>();
     }
   }
   return std::nullopt;
 }
 
 std::optional<json> aria2::rpc_get_status(const std::string& gid) {
-  json payload = {
-      {"jsonrpc", "2.0"},
-      {"id", "JID"},
-      {"method", "aria2.tellStatus"},
-      {"params", {"token:nuclearlaunchcode", gid, json::array({"status", "totalLength", "completedLength", "downloadSpeed", "connections"})}}};
-
-  cpr::Response response =
-      cpr::Post(cpr::Url{"http://localhost:6800/jsonrpc"}, cpr::Body{payload.dump()}, cpr::Header{{"Content-Type", "application/json"}});
+  return rpc_request("aria2.tellStatus", json::array({gid, status_keys()}));
+}
 
-  if (response.status_code == 200) {
-    auto parsed_json = json::parse(response.text);
-    return parsed_json;
+std::vector<std::optional<json>> aria2::rpc_get_statuses(const std::vector<std::string>& gids) {
+  std::vector<std::optional<json>> statuses(gids.size());
+  if (gids.empty()) {
+    return statuses;
   }
-  return std::nullopt;
+  if (auto results = rpc_multicall("aria2.tellStatus", gids, status_keys())) {
+    for (size_t i = 0; i < gids.size() && i < results->size(); ++i) {
+      if (auto& result = (*results)[i]; result.is_array() && !result.empty()) {
+        statuses[i] = std::move(result[0]);
+      }
+    }
+  }
+  return statuses;
 }
 
 bool aria2::rpc_remove_download(const std::string& gid) {
-  json payload = {{"jsonrpc", "2.0"}, {"id", "JID"}, {"method", "aria2.remove"}, {"params", {"token:nuclearlaunchcode", gid}}};
+  if (auto parsed_json = rpc_request("aria2.remove", json::array({gid}))) {
+    if (parsed_json->contains("result")) {
+      if ((*parsed_json)["result"].get<std::string>() == gid) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
 
-  cpr::Response response =
-      cpr::Post(cpr::Url{"http://localhost:6800/jsonrpc"}, cpr::Body{payload.dump()}, cpr::Header{{"Content-Type", "application/json"}});
+std::vector<std::string> aria2::rpc_get_file_paths(const std::string& gid) {
+  std::vector<std::string> paths;
+  if (auto parsed_json = rpc_request("aria2.getFiles", json::array({gid})); parsed_json && (*parsed_json)["result"].is_array()) {
+    for (const auto& file : (*parsed_json)["result"]) {
+      if (auto path = file.value("path", ""); !path.empty()) {
+        paths.push_back(std::move(path));
+      }
+    }
+  }
+  return paths;
+}
 
-  if (response.status_code == 200) {
-    auto parsed_json = json::parse(response.text);
-    if (parsed_json.contains("result")) {
-      if (parsed_json["result"].get<std::string>() == gid) {
-        return true;
+bool aria2::rpc_remove_download_result(const std::string& gid) {
+  if (auto parsed_json = rpc_request("aria2.removeDownloadResult", json::array({gid}))) {
+    return parsed_json->contains("result") && (*parsed_json)["result"] == "OK";
+  }
+  return false;
+}
+
+void aria2::set_rpc_url(std::string url) {
+  rpc_url = std::move(url);
+}
+
+size_t aria2::rpc_pause_downloads(const std::vector<std::string>& gids) {
+  if (gids.empty()) {
+    return 0;
+  }
+  auto results = rpc_multicall("aria2.forcePause", gids);
+  if (!results) {
+    return 0;
+  }
+  return static_cast<size_t>(std::ranges::count_if(*results, [](const json& result) { return result.is_array(); }));
+}
+
+std::vector<std::string> aria2::rpc_unpause_downloads(const std::vector<std::string>& gids) {
+  std::vector<std::string> resumed;
+  if (gids.empty()) {
+    return resumed;
+  }
+  if (auto results = rpc_multicall("aria2.unpause", gids)) {
+    for (size_t i = 0; i < gids.size() && i < results->size(); ++i) {
+      if ((*results)[i].is_array()) {
+        resumed.push_back(gids[i]);
       }
     }
   }
+  return resumed;
+}
+
+bool aria2::rpc_save_session() {
+  if (auto parsed_json = rpc_request("aria2.saveSession")) {
+    return parsed_json->contains("result") && (*parsed_json)["result"] == "OK";
+  }
   return false;
 }
+
+bool aria2::is_link_error(int error_code) {
+  switch (error_code) {
+  case 2:  // timeout
+  case 3:  // resource not found
+  case 4:  // too many "resource not found" errors
+  case 5:  // download speed too slow
+  case 6:  // network problem
+  case 8:  // server does not support resuming
+  case 19: // name resolution failed
+  case 22: // bad or unexpected HTTP response
+  case 23: // too many redirects
+  case 24: // HTTP authorization failed
+  case 29: // server temporarily overloaded
+    return true;
+  default:
+    return false;
+  }
+}
+
+bool aria2::is_congestion_error(int error_code) {
+  switch (error_code) {
+  case 2:  // timeout
+  case 6:  // network problem
+  case 29: // server temporarily overloaded (HTTP 503)
+    return true;
+  default:
+    return false;
+  }
+}
@@ -0,0 +1,304 @@
+#include "async.hpp"
+#include "logging.hpp"
+#include "shutdown_handler.hpp"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <curl/curl.h>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Longest the loop blocks without looking at the shutdown flag
+constexpr std::chrono::milliseconds max_wait{100};
+
+} // namespace
+
+std::string async::form_encode(const Form& fields) {
+  std::string body;
+  for (const auto& [key, value] : fields) {
+    if (!body.empty()) {
+      body += '&';
+    }
+    char* escaped_key = curl_easy_escape(nullptr, key.c_str(), static_cast<int>(key.size()));
+    char* escaped_value = curl_easy_escape(nullptr, value.c_str(), static_cast<int>(value.size()));
+    body += escaped_key;
+    body += '=';
+    body += escaped_value;
+    curl_free(escaped_key);
+    curl_free(escaped_value);
+  }
+  return body;
+}
+
+bool async::SleepAwaiter::await_ready() const noexcept {
+  return loop.cancelled || duration <= std::chrono::steady_clock::duration::zero();
+}
+
+async::SleepAwaiter::~SleepAwaiter() {
+  if (registered) {
+    auto [first, last] = loop.timers.equal_range(deadline);
+    loop.timers.erase(std::find_if(first, last, [this](const auto& timer) { return timer.second == this; }));
+  }
+}
+
+void async::SleepAwaiter::await_suspend(std::coroutine_handle<> handle) {
+  waiter = handle;
+  deadline = std::chrono::steady_clock::now() + duration;
+  loop.timers.emplace(deadline, this);
+  registered = true;
+}
+
+bool async::WakeAwaiter::await_ready() const noexcept {
+  return loop.cancelled;
+}
+
+async::WakeAwaiter::~WakeAwaiter() {
+  if (registered) {
+    std::erase(loop.wake_waiters, this);
+    std::erase(loop.waking, this);
+  }
+}
+
+void async::WakeAwaiter::await_suspend(std::coroutine_handle<> handle) {
+  waiter = handle;
+  loop.wake_waiters.push_back(this);
+  registered = true;
+}
+
+async::TransferAwaiter::~TransferAwaiter() {
+  // Only reached with a live handle if the awaiting coroutine was destroyed mid-transfer
+  if (easy != nullptr) {
+    curl_multi_remove_handle(loop.multi, easy);
+    curl_easy_cleanup(easy);
+    loop.transfers.erase(this);
+  }
+  curl_slist_free_all(header_list);
+}
+
+bool async::TransferAwaiter::await_ready() noexcept {
+  response.cancelled = loop.cancelled;
+  return loop.cancelled;
+}
+
+bool async::TransferAwaiter::await_suspend(std::coroutine_handle<> handle) {
+  easy = curl_easy_init();
+  if (easy == nullptr) {
+    response.error = "Could not create a curl handle";
+    return false;
+  }
+
+  curl_easy_setopt(easy, CURLOPT_URL, request.url.c_str());
+  curl_easy_setopt(easy, CURLOPT_PRIVATE, this);
+  curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, write_callback);
+  curl_easy_setopt(easy, CURLOPT_WRITEDATA, this);
+  curl_easy_setopt(easy, CURLOPT_HEADERFUNCTION, header_callback);
+  curl_easy_setopt(easy, CURLOPT_HEADERDATA, this);
+  curl_easy_setopt(easy, CURLOPT_ERRORBUFFER, error_buffer.data());
+  curl_easy_setopt(easy, CURLOPT_NOSIGNAL, 1L);
+  if (request.decode_content) {
+    curl_easy_setopt(easy, CURLOPT_ACCEPT_ENCODING, "");
+  }
+  curl_easy_setopt(easy, CURLOPT_TIMEOUT_MS, static_cast<long>(request.timeout.count()));
+
+  if (request.method == "POST") {
+    curl_easy_setopt(easy, CURLOPT_POST, 1L);
+  } else if (request.method == "HEAD") {
+    curl_easy_setopt(easy, CURLOPT_NOBODY, 1L);
+  } else if (request.method != "GET") {
+    curl_easy_setopt(easy, CURLOPT_CUSTOMREQUEST, request.method.c_str());
+  }
+  if (!request.body.empty() || request.method == "POST") {
+    curl_easy_setopt(easy, CURLOPT_POSTFIELDSIZE, static_cast<long>(request.body.size()));
+    curl_easy_setopt(easy, CURLOPT_POSTFIELDS, request.body.c_str());
+  }
+  for (const auto& header : request.headers) {
+    header_list = curl_slist_append(header_list, header.c_str());
+  }
+  curl_easy_setopt(easy, CURLOPT_HTTPHEADER, header_list);
+
+  if (curl_multi_add_handle(loop.multi, easy) != CURLM_OK) {
+    curl_easy_cleanup(easy);
+    easy = nullptr;
+    response.error = "Could not queue the transfer";
+    return false;
+  }
+  waiter = handle;
+  loop.transfers.insert(this);
+  return true;
+}
+
+size_t async::TransferAwaiter::write_callback(char* data, size_t size, size_t count, void* user) {
+  static_cast<TransferAwaiter*>(user)->response.text.append(data, size * count);
+  return size * count;
+}
+
+size_t async::TransferAwaiter::header_callback(char* data, size_t size, size_t count, void* user) {
+  std::string_view line{data, size * count};
+  if (auto colon = line.find(':'); colon != std::string_view::npos) {
+    std::string name{line.substr(0, colon)};
+    std::ranges::transform(name, name.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    auto value = line.substr(colon + 1);
+    value.remove_prefix(std::min(value.find_first_not_of(' '), value.size()));
+    value = value.substr(0, value.find_last_not_of("\r\n ") + 1);
+    static_cast<TransferAwaiter*>(user)->response.headers.insert_or_assign(std::move(name), std::string{value});
+  }
+  return size * count;
+}
+
+void async::TransferAwaiter::complete(CURLcode result) {
+  curl_easy_getinfo(easy, CURLINFO_RESPONSE_CODE, &response.status_code);
+  if (result != CURLE_OK) {
+    response.error = error_buffer[0] != '\0' ? error_buffer.data() : curl_easy_strerror(result);
+  }
+  curl_multi_remove_handle(loop.multi, easy);
+  curl_easy_cleanup(easy);
+  easy = nullptr;
+  loop.transfers.erase(this);
+  waiter.resume();
+}
+
+async::EventLoop::EventLoop() {
+  curl_global_init(CURL_GLOBAL_DEFAULT);
+  multi = curl_multi_init();
+  if (multi == nullptr) {
+    throw std::runtime_error("Could not create a curl multi handle");
+  }
+}
+
+async::EventLoop::~EventLoop() {
+  // Background tasks go first, their transfers still need the multi handle
+  spawned.clear();
+  curl_multi_cleanup(multi);
+  curl_global_cleanup();
+}
+
+void async::EventLoop::spawn(Task<void> task) {
+  task.start();
+  spawned.push_back(std::move(task));
+}
+
+void async::EventLoop::cancel_all() {
+  cancelled = true;
+
+  // One at a time from the live containers: a resumed coroutine may destroy other awaiters, which then deregister themselves
+  while (!timers.empty()) {
+    auto* sleep = timers.begin()->second;
+    timers.erase(timers.begin());
+    sleep->registered = false;
+    sleep->cancelled = true;
+    sleep->waiter.resume();
+  }
+
+  waking.insert(waking.end(), wake_waiters.begin(), wake_waiters.end());
+  wake_waiters.clear();
+  while (!waking.empty()) {
+    auto* wake = waking.front();
+    waking.erase(waking.begin());
+    wake->registered = false;
+    wake->cancelled = true;
+    wake->waiter.resume();
+  }
+
+  auto pending_transfers = std::vector<TransferAwaiter*>(transfers.begin(), transfers.end());
+  for (auto* transfer : pending_transfers) {
+    transfer->response.cancelled = true;
+    transfer->complete(CURLE_ABORTED_BY_CALLBACK);
+  }
+}
+
+void async::EventLoop::step() {
+  if (shutdown_handler::shutdown_requested && !cancelled) {
+    cancel_all();
+    return;
+  }
+
+  bool resumed = false;
+  auto now = std::chrono::steady_clock::now();
+  while (!timers.empty() && timers.begin()->first <= now) {
+    auto* sleep = timers.begin()->second;
+    timers.erase(timers.begin());
+    sleep->registered = false;
+    sleep->waiter.resume();
+    resumed = true;
+  }
+  if (wake_pending.exchange(false, std::memory_order_acquire)) {
+    // Waiters that register while this round runs wait for the next wake()
+    waking = std::exchange(wake_waiters, {});
+    resumed = resumed || !waking.empty();
+    while (!waking.empty()) {
+      auto* wake = waking.front();
+      waking.erase(waking.begin());
+      wake->registered = false;
+      wake->waiter.resume();
+    }
+  }
+
+  int running = 0;
+  curl_multi_perform(multi, &running);
+
+  // Collect first: resuming a coroutine may queue new transfers
+  std::vector<std::pair<TransferAwaiter*, CURLcode>> finished;
+  int queued = 0;
+  while (CURLMsg* message = curl_multi_info_read(multi, &queued)) {
+    if (message->msg == CURLMSG_DONE) {
+      TransferAwaiter* transfer = nullptr;
+      curl_easy_getinfo(message->easy_handle, CURLINFO_PRIVATE, &transfer);
+      finished.emplace_back(transfer, message->data.result);
+    }
+  }
+  for (auto [transfer, result] : finished) {
+    transfer->complete(result);
+    resumed = true;
+  }
+
+  std::erase_if(spawned, [](Task<void>& task) {
+    if (!task.done()) {
+      return false;
+    }
+    try {
+      task.result();
+    } catch (const std::exception& e) {
+      logging::error("async", "Background task failed: {}", e.what());
+    }
+    return true;
+  });
+
+  if (resumed) {
+    return;
+  }
+  if (transfers.empty() && timers.empty() && wake_waiters.empty()) {
+    throw std::logic_error("[async] Tasks are suspended with nothing left to wake them");
+  }
+
+  auto wait = max_wait;
+  if (!timers.empty()) {
+    auto until_timer = std::chrono::ceil<std::chrono::milliseconds>(timers.begin()->first - std::chrono::steady_clock::now());
+    wait = std::clamp(until_timer, std::chrono::milliseconds::zero(), max_wait);
+  }
+  // Waits even with no transfers in flight, and returns early on wake()
+  curl_multi_poll(multi, nullptr, 0, static_cast<int>(wait.count()), nullptr);
+}
+
+void async::EventLoop::wake() noexcept {
+  wake_pending.store(true, std::memory_order_release);
+  curl_multi_wakeup(multi);
+}
+
+async::RateLimiter::RateLimiter(size_t capacity, double rate_per_sec)
+    : interval(std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / rate_per_sec))),
+      burst(interval * static_cast<std::int64_t>(capacity > 0 ? capacity - 1 : 0)), next_arrival(std::chrono::steady_clock::now()) {}
+
+async::Task<bool> async::RateLimiter::acquire(EventLoop& loop) {
+  // Generic cell rate algorithm: reserve the next slot, then sleep until it is within the burst allowance
+  auto now = std::chrono::steady_clock::now();
+  next_arrival = std::max(next_arrival, now);
+  auto start_at = next_arrival - burst;
+  next_arrival += interval;
+  if (start_at > now) {
+    co_return co_await loop.sleep_for(start_at - now);
+  }
+  co_return !loop.is_cancelled();
+}
@@ -0,0 +1,140 @@
+#include "concurrency.hpp"
+#include "aria2_manager.hpp"
+#include "hoster.hpp"
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace {
+
+// A probe has to lift the speed by this much to be kept, so noise alone does not ratchet the knobs up
+constexpr double min_gain = 0.05;
+
+// Windows to sit still after a probe failed to pay off, before trying again
+constexpr size_t settle_windows = 6;
+
+json connection_options(size_t connections) {
+  return {{"split", std::to_string(connections)}, {"max-connection-per-server", std::to_string(connections)}};
+}
+
+} // namespace
+
+concurrency::Controller::Controller(Limits start, Limits ceiling, std::chrono::steady_clock::duration window)
+    : current(start), ceiling(ceiling), window(window), window_start(std::chrono::steady_clock::now()) {
+  this->ceiling.slots = std::max(ceiling.slots, start.slots);
+  this->ceiling.connections = std::max(ceiling.connections, start.connections);
+}
+
+void concurrency::Controller::observe_speed(std::uint64_t bytes_per_second) {
+  speed_sum += bytes_per_second;
+  ++samples;
+}
+
+void concurrency::Controller::observe_error(std::string_view host) {
+  if (auto it = errors.find(host); it != errors.end()) {
+    ++it->second;
+  } else {
+    errors.emplace(host, 1);
+  }
+}
+
+std::optional<concurrency::Adjustment> concurrency::Controller::step(std::chrono::steady_clock::time_point now) {
+  if (now - window_start < window) {
+    return std::nullopt;
+  }
+  window_start = now;
+  auto speed = samples > 0 ? static_cast<double>(speed_sum) / static_cast<double>(samples) : 0.0;
+  speed_sum = 0;
+  samples = 0;
+  auto previous = current;
+  Adjustment adjustment{current, {}};
+  bool congested = !errors.empty();
+
+  if (congested) {
+    // Multiplicative decrease, then one window to let the servers recover
+    current.connections = std::max<size_t>(current.connections / 2, 1);
+    for (const auto& [host, count] : errors) {
+      auto& cap = host_caps.try_emplace(host, previous.connections).first->second;
+      cap = std::max<size_t>(std::min(cap, previous.connections) / 2, 1);
+      adjustment.host_connections.emplace_back(host, cap);
+    }
+    errors.clear();
+    probing = Knob::None;
+    hold_windows = 1;
+  } else if (probing != Knob::None && speed < baseline * (1 + min_gain)) {
+    // The last step up did not pay off: take it back and stay there for a while
+    (probing == Knob::Slots ? current.slots : current.connections) -= 1;
+    next_knob = probing == Knob::Slots ? Knob::Connections : Knob::Slots;
+    probing = Knob::None;
+    hold_windows = settle_windows;
+  } else if (hold_windows > 0) {
+    --hold_windows;
+    probing = Knob::None;
+  } else {
+    // Additive increase
+    baseline = speed;
+    probe();
+  }
+
+  if (!congested) {
+    // Additive increase for the hosts that were backed off too: one connection per clean window, until they are back
+    // at the global value and need no cap of their own
+    for (auto it = host_caps.begin(); it != host_caps.end();) {
+      auto cap = std::min(it->second + 1, current.connections);
+      adjustment.host_connections.emplace_back(it->first, cap);
+      if (cap == current.connections) {
+        it = host_caps.erase(it);
+      } else {
+        it->second = cap;
+        ++it;
+      }
+    }
+  }
+
+  if (current == previous && adjustment.host_connections.empty()) {
+    return std::nullopt;
+  }
+  adjustment.limits = current;
+  return adjustment;
+}
+
+void concurrency::Controller::probe() {
+  for (int attempt = 0; attempt < 2; ++attempt) {
+    auto knob = next_knob;
+    next_knob = knob == Knob::Slots ? Knob::Connections : Knob::Slots;
+    auto& value = knob == Knob::Slots ? current.slots : current.connections;
+    if (value < (knob == Knob::Slots ? ceiling.slots : ceiling.connections)) {
+      ++value;
+      probing = knob;
+      return;
+    }
+  }
+  // Both knobs are at their ceiling
+  probing = Knob::None;
+}
+
+void concurrency::apply(const Adjustment& adjustment, const std::vector<util::FileDownloadProgress>& files) {
+  auto options = connection_options(adjustment.limits.connections);
+  options["max-concurrent-downloads"] = std::to_string(adjustment.limits.slots);
+  aria2::rpc_change_global_option(options);
+
+  // The global options only reach downloads started from now on; the running ones are what the next window measures
+  std::vector<std::string> unfinished;
+  for (const auto& file : files) {
+    if (!file.get_completion_status() && !file.get_gid().empty()) {
+      unfinished.push_back(file.get_gid());
+    }
+  }
+  aria2::rpc_change_options(unfinished, connection_options(adjustment.limits.connections));
+
+  // Then the congested hosts' own caps on top
+  for (const auto& [host, connections] : adjustment.host_connections) {
+    std::vector<std::string> gids;
+    for (const auto& file : files) {
+      if (!file.get_completion_status() && hoster::host_of(file.get_link()) == host) {
+        gids.push_back(file.get_gid());
+      }
+    }
+    aria2::rpc_change_options(gids, connection_options(connections));
+  }
+}
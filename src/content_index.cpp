@@ -0,0 +1,248 @@
+#include "content_index.hpp"
+#include "logging.hpp"
+#include "util.hpp"
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr std::uint64_t prime_1 = 11400714785074694791ULL;
+constexpr std::uint64_t prime_2 = 14029467366897019727ULL;
+constexpr std::uint64_t prime_3 = 1609587929392839161ULL;
+constexpr std::uint64_t prime_4 = 9650029242287828579ULL;
+constexpr std::uint64_t prime_5 = 2870177450012600261ULL;
+
+constexpr std::string_view index_file_name{".rddl_index"};
+
+std::uint64_t rotl(std::uint64_t value, int bits) {
+  return (value << bits) | (value >> (64 - bits));
+}
+
+std::uint64_t read_u64(const std::byte* data) {
+  std::uint64_t value;
+  std::memcpy(&value, data, sizeof(value));
+  return value;
+}
+
+std::uint32_t read_u32(const std::byte* data) {
+  std::uint32_t value;
+  std::memcpy(&value, data, sizeof(value));
+  return value;
+}
+
+std::uint64_t round(std::uint64_t accumulator, std::uint64_t input) {
+  accumulator += input * prime_2;
+  accumulator = rotl(accumulator, 31);
+  return accumulator * prime_1;
+}
+
+std::uint64_t merge_round(std::uint64_t accumulator, std::uint64_t value) {
+  accumulator ^= round(0, value);
+  return accumulator * prime_1 + prime_4;
+}
+
+} // namespace
+
+content_index::Hasher::Hasher(std::uint64_t seed)
+    : accumulators{seed + prime_1 + prime_2, seed + prime_2, seed, seed - prime_1}, buffer{}, seed(seed) {}
+
+void content_index::Hasher::update(const std::byte* data, size_t length) {
+  total_length += length;
+
+  // Top up a partially filled stripe first
+  if (buffered > 0) {
+    size_t take = std::min(length, sizeof(buffer) - buffered);
+    std::memcpy(buffer + buffered, data, take);
+    buffered += take;
+    data += take;
+    length -= take;
+    if (buffered < sizeof(buffer)) {
+      return;
+    }
+    for (size_t lane = 0; lane < 4; ++lane) {
+      accumulators[lane] = round(accumulators[lane], read_u64(buffer + lane * 8));
+    }
+    buffered = 0;
+  }
+
+  while (length >= 32) {
+    for (size_t lane = 0; lane < 4; ++lane) {
+      accumulators[lane] = round(accumulators[lane], read_u64(data + lane * 8));
+    }
+    data += 32;
+    length -= 32;
+  }
+
+  std::memcpy(buffer, data, length);
+  buffered = length;
+}
+
+std::uint64_t content_index::Hasher::digest() const {
+  std::uint64_t hash;
+  if (total_length >= 32) {
+    hash = rotl(accumulators[0], 1) + rotl(accumulators[1], 7) + rotl(accumulators[2], 12) + rotl(accumulators[3], 18);
+    for (auto accumulator : accumulators) {
+      hash = merge_round(hash, accumulator);
+    }
+  } else {
+    hash = seed + prime_5;
+  }
+  hash += total_length;
+
+  const std::byte* tail = buffer;
+  size_t remaining = buffered;
+  for (; remaining >= 8; tail += 8, remaining -= 8) {
+    hash ^= round(0, read_u64(tail));
+    hash = rotl(hash, 27) * prime_1 + prime_4;
+  }
+  if (remaining >= 4) {
+    hash ^= static_cast<std::uint64_t>(read_u32(tail)) * prime_1;
+    hash = rotl(hash, 23) * prime_2 + prime_3;
+    tail += 4;
+    remaining -= 4;
+  }
+  for (; remaining > 0; ++tail, --remaining) {
+    hash ^= static_cast<std::uint64_t>(*tail) * prime_5;
+    hash = rotl(hash, 11) * prime_1;
+  }
+
+  hash ^= hash >> 33;
+  hash *= prime_2;
+  hash ^= hash >> 29;
+  hash *= prime_3;
+  hash ^= hash >> 32;
+  return hash;
+}
+
+std::optional<std::uint64_t> content_index::hash_file(const fs::path& path) {
+  util::MappedFile file{path.string()};
+  if (!file.is_open()) {
+    return std::nullopt;
+  }
+  Hasher hasher;
+  auto contents = file.view();
+  hasher.update(reinterpret_cast<const std::byte*>(contents.data()), contents.size());
+  return hasher.digest();
+}
+
+content_index::ContentIndex::ContentIndex(fs::path root) : root(std::move(root)), index_path(this->root / index_file_name) {}
+
+void content_index::ContentIndex::load() {
+  std::ifstream file(index_path);
+  if (!file) {
+    return;
+  }
+
+  // One entry per line: hash \t size \t mtime \t verified \t path
+  std::string line;
+  while (std::getline(file, line)) {
+    std::string_view fields{line};
+    Entry entry{};
+    int verified = 0;
+    auto parse_field = [&fields](auto& value, int base = 10) {
+      auto tab = fields.find('\t');
+      if (tab == std::string_view::npos) {
+        return false;
+      }
+      auto [end, error] = std::from_chars(fields.data(), fields.data() + tab, value, base);
+      fields.remove_prefix(tab + 1);
+      return error == std::errc{};
+    };
+    if (parse_field(entry.hash, 16) && parse_field(entry.size) && parse_field(entry.mtime) && parse_field(verified) && !fields.empty()) {
+      entry.verified = verified != 0;
+      entries.insert_or_assign(std::string{fields}, entry);
+    }
+  }
+}
+
+bool content_index::ContentIndex::save() const {
+  std::error_code error;
+  fs::create_directories(root, error);
+
+  std::string contents;
+  for (const auto& [path, entry] : entries) {
+    std::format_to(std::back_inserter(contents), "{:016x}\t{}\t{}\t{}\t{}\n", entry.hash, entry.size, entry.mtime, entry.verified ? 1 : 0, path);
+  }
+
+  return util::write_file_atomically(index_path.string(), contents);
+}
+
+void content_index::ContentIndex::refresh(const std::vector<std::string>& relative_paths) {
+  struct Pending {
+    std::string path;
+    Entry entry;
+    std::optional<std::uint64_t> hash;
+  };
+  std::vector<Pending> pending;
+
+  // Only finished files whose size or mtime moved since the last run get rehashed
+  for (const auto& relative_path : relative_paths) {
+    std::error_code error;
+    auto full_path = root / relative_path;
+    auto size = fs::file_size(full_path, error);
+    auto mtime = error ? fs::file_time_type{} : fs::last_write_time(full_path, error);
+    if (error) {
+      entries.erase(relative_path);
+      continue;
+    }
+    auto ticks = static_cast<std::int64_t>(mtime.time_since_epoch().count());
+    // aria2 keeps a .aria2 control file next to anything still in progress; hashing those (often preallocated to full
+    // size) would read gigabytes aria2 is still writing, so they are recorded without a hash
+    if (fs::exists(root / (relative_path + ".aria2"))) {
+      entries.insert_or_assign(relative_path, Entry{size, ticks, 0, false});
+      continue;
+    }
+    // An entry recorded while in progress is hashed once it is complete, even if its size and mtime stayed put
+    if (auto it = entries.find(relative_path);
+        it != entries.end() && it->second.size == size && it->second.mtime == ticks && (it->second.verified || it->second.hash != 0)) {
+      continue;
+    }
+    pending.push_back({relative_path, Entry{size, ticks, 0, false}, std::nullopt});
+  }
+  if (pending.empty()) {
+    return;
+  }
+
+  std::atomic<size_t> next{0};
+  size_t worker_count = std::min<size_t>(pending.size(), std::max(1u, std::thread::hardware_concurrency()));
+  {
+    std::vector<std::jthread> workers;
+    for (size_t i = 0; i < worker_count; ++i) {
+      workers.emplace_back([&] {
+        for (size_t job = next++; job < pending.size(); job = next++) {
+          pending[job].hash = hash_file(root / pending[job].path);
+        }
+      });
+    }
+  }
+
+  for (auto& [path, entry, hash] : pending) {
+    if (!hash) {
+      entries.erase(path);
+      continue;
+    }
+    entry.hash = *hash;
+    auto previous = entries.find(path);
+    bool content_changed = previous != entries.end() && previous->second.verified && previous->second.hash != entry.hash;
+    entry.verified = !content_changed;
+    entries.insert_or_assign(path, entry);
+  }
+}
+
+bool content_index::ContentIndex::is_present(const std::string& relative_path, std::uint64_t expected_size) const {
+  auto it = entries.find(relative_path);
+  if (it == entries.end() || !it->second.verified) {
+    return false;
+  }
+  return expected_size == 0 || it->second.size == expected_size;
+}
@@ -0,0 +1,80 @@
+#include "hoster.hpp"
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace {
+
+std::string_view trim(std::string_view text) {
+  auto begin = text.find_first_not_of(" \t\r");
+  if (begin == std::string_view::npos) {
+    return {};
+  }
+  return text.substr(begin, text.find_last_not_of(" \t\r") - begin + 1);
+}
+
+} // namespace
+
+std::optional<std::string_view> hoster::host_of(std::string_view url) {
+  for (std::string_view scheme : {"https://", "http://"}) {
+    if (url.starts_with(scheme)) {
+      auto host = url.substr(scheme.size());
+      host = host.substr(0, host.find_first_of("/?#"));
+      host = host.substr(host.find('@') == std::string_view::npos ? 0 : host.find('@') + 1);
+      host = host.substr(0, host.find(':'));
+      if (host.starts_with("www.")) {
+        host.remove_prefix(4);
+      }
+      if (host.empty()) {
+        return std::nullopt;
+      }
+      return host;
+    }
+  }
+  return std::nullopt;
+}
+
+std::vector<std::string> hoster::ingest(std::string_view contents, IngestStats& stats) {
+  std::vector<std::string> links;
+  std::unordered_set<std::string_view> seen;
+  while (!contents.empty()) {
+    auto line_end = contents.find('\n');
+    auto line = trim(contents.substr(0, line_end));
+    contents.remove_prefix(line_end == std::string_view::npos ? contents.size() : line_end + 1);
+    // Blank lines and comments don't count as entries
+    if (line.empty() || line.front() == '#') {
+      continue;
+    }
+    ++stats.lines;
+
+    if (!host_of(line)) {
+      ++stats.invalid;
+    } else if (!seen.insert(line).second) {
+      ++stats.duplicates;
+    } else {
+      links.emplace_back(line);
+    }
+  }
+  return links;
+}
+
+std::vector<api::Torrent> hoster::group_by_host(const std::vector<api::LinkInfo>& live_links) {
+  std::vector<api::Torrent> groups;
+  std::unordered_map<std::string, size_t> group_of_host;
+  for (const auto& info : live_links) {
+    std::string host{info.host.empty() ? host_of(info.link).value_or("unknown") : info.host};
+    auto [it, inserted] = group_of_host.try_emplace(host, groups.size());
+    if (inserted) {
+      groups.push_back(api::Torrent{"", host, {}, {}, {}, 0});
+    }
+    auto& group = groups[it->second];
+    group.files.push_back(info.filename.empty() ? std::string{info.link.substr(info.link.find_last_of('/') + 1)} : info.filename);
+    group.file_sizes.push_back(info.size);
+    group.links.push_back(info.link);
+    group.size += info.size;
+  }
+  return groups;
+}
@@ -0,0 +1,404 @@
+#include "library.hpp"
+#include "logging.hpp"
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <format>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+using json = nlohmann::json;
+namespace fs = std::filesystem;
+
+namespace {
+
+// On-disk layout: Header, record_count fixed size Records, then one string table.
+// Numbers are stored in the writing machine's byte order and read with memcpy, so the file can be used straight from the mapping;
+// `byte_order` holds byte_order_mark as written, which reads back differently on a machine of the other endianness.
+constexpr char magic[8] = {'R', 'D', 'D', 'L', 'L', 'I', 'B', '1'};
+constexpr std::uint32_t format_version = 2;
+constexpr std::uint32_t byte_order_mark = 0x01020304;
+
+struct Header {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t byte_order;
+  std::uint64_t record_count;
+  std::uint64_t strings_offset;
+  std::uint64_t strings_size;
+  std::uint64_t reserved_2;
+};
+
+struct StringRef {
+  std::uint32_t offset;
+  std::uint32_t length;
+};
+
+struct Record {
+  StringRef id, name, hash, status, link;
+  std::uint64_t bytes;
+  std::int64_t added;
+  std::uint8_t kind;
+  std::uint8_t padding[7];
+};
+
+static_assert(sizeof(Header) == 48 && sizeof(Record) == 64);
+
+// Pages fetched when listing everything; incremental syncs start smaller
+constexpr std::uint64_t full_page_limit = 1000;
+constexpr std::uint64_t incremental_page_limit = 50;
+
+std::string_view endpoint_for(library::Kind kind) {
+  return kind == library::Kind::Torrent ? "/torrents" : "/downloads";
+}
+
+std::string_view resolve(std::string_view strings, StringRef ref) {
+  if (static_cast<std::uint64_t>(ref.offset) + ref.length > strings.size()) {
+    return {};
+  }
+  return strings.substr(ref.offset, ref.length);
+}
+
+bool icontains(std::string_view haystack, std::string_view needle) {
+  auto lower = [](char c) { return static_cast<char>(c >= 'A' && c <= 'Z' ? c | 0x20 : c); };
+  return !std::ranges::search(haystack, needle, [&](char a, char b) { return lower(a) == lower(b); }).empty();
+}
+
+library::Entry entry_from_json(library::Kind kind, const json& item) {
+  library::Entry entry{.kind = kind, .id = item.value("id", std::string{}), .name = item.value("filename", std::string{}), .hash = {},
+                       .status = {}, .link = {}, .bytes = 0, .added = 0};
+  if (kind == library::Kind::Torrent) {
+    entry.hash = item.value("hash", std::string{});
+    std::ranges::transform(entry.hash, entry.hash.begin(), [](char c) { return static_cast<char>(c >= 'A' && c <= 'Z' ? c | 0x20 : c); });
+    entry.status = item.value("status", std::string{});
+    entry.bytes = item.value("bytes", std::uint64_t{0});
+    entry.added = library::parse_timestamp(item.value("added", std::string{})).value_or(0);
+  } else {
+    entry.status = item.value("host", std::string{});
+    entry.link = item.value("download", std::string{});
+    entry.bytes = item.value("filesize", std::uint64_t{0});
+    entry.added = library::parse_timestamp(item.value("generated", std::string{})).value_or(0);
+  }
+  return entry;
+}
+
+// Torrents whose status can still change; downloads never do
+bool in_progress(const library::Entry& entry) {
+  static const std::unordered_set<std::string_view> settled{"downloaded", "error", "magnet_error", "virus", "dead"};
+  return entry.kind == library::Kind::Torrent && !settled.contains(entry.status);
+}
+
+// Lists everything: the first page gives X-Total-Count, the rest are fetched concurrently
+async::Task<std::optional<std::vector<library::Entry>>> fetch_all(async::EventLoop& loop, const api::RealDebridClient& client, library::Kind kind) {
+  std::string endpoint{endpoint_for(kind)};
+  auto first_page = co_await client.list_async(loop, endpoint, 0, full_page_limit);
+  if (!first_page) {
+    co_return std::nullopt;
+  }
+
+  // The client's own rate limiter spaces these out
+  std::vector<async::Task<std::optional<api::Page>>> requests;
+  for (std::uint64_t offset = first_page->items.size(); offset < first_page->total_count; offset += full_page_limit) {
+    requests.push_back(client.list_async(loop, endpoint, offset, full_page_limit));
+  }
+  auto pages = co_await async::gather(std::move(requests));
+
+  std::vector<library::Entry> entries;
+  entries.reserve(first_page->total_count);
+  std::unordered_set<std::string> seen;
+  auto append = [&](const api::Page& page) {
+    for (const auto& item : page.items) {
+      // Entries added mid-crawl shift the pages, so the same id can show up twice
+      auto entry = entry_from_json(kind, item);
+      if (seen.insert(entry.id).second) {
+        entries.push_back(std::move(entry));
+      }
+    }
+  };
+  append(*first_page);
+  for (const auto& page : pages) {
+    if (!page) {
+      co_return std::nullopt;
+    }
+    append(*page);
+  }
+  co_return entries;
+}
+
+// Walks from the newest entry through the first page that holds one the library already has unchanged, comparing every
+// entry on the way; falls back to listing everything when the walk cannot account for the rest
+async::Task<std::optional<std::vector<library::Entry>>> sync_kind(async::EventLoop& loop, const api::RealDebridClient& client, library::Kind kind,
+                                                                  std::vector<library::Entry> local, library::SyncStats& stats) {
+  std::unordered_map<std::string, size_t> known;
+  known.reserve(local.size());
+  for (size_t i = 0; i < local.size(); ++i) {
+    known.emplace(local[i].id, i);
+  }
+
+  std::vector<library::Entry> fresh;
+  std::uint64_t total = 0;
+  size_t added = 0;
+  size_t updated = 0;
+  bool stale = false;
+  if (!local.empty()) {
+    std::uint64_t offset = 0;
+    std::uint64_t limit = incremental_page_limit;
+    bool caught_up = false;
+    std::unordered_set<std::string> seen;
+    std::optional<size_t> walked_to; // oldest local entry the walk reached
+    while (!caught_up) {
+      auto page = co_await client.list_async(loop, std::string{endpoint_for(kind)}, offset, limit);
+      if (!page) {
+        co_return std::nullopt;
+      }
+      total = page->total_count;
+      for (const auto& item : page->items) {
+        auto entry = entry_from_json(kind, item);
+        seen.insert(entry.id);
+        if (auto it = known.find(entry.id); it == known.end()) {
+          fresh.push_back(std::move(entry));
+          ++added;
+        } else {
+          walked_to = std::max(walked_to.value_or(0), it->second);
+          if (local[it->second] == entry) {
+            // The rest of this page is still compared, so status changes among the newest entries are not missed
+            caught_up = true;
+          } else {
+            local[it->second] = std::move(entry);
+            ++updated;
+          }
+        }
+      }
+      if (page->items.size() < limit) {
+        break;
+      }
+      offset += page->items.size();
+      limit = std::min(limit * 2, full_page_limit);
+    }
+
+    for (size_t i = 0; i < local.size(); ++i) {
+      if (walked_to && i <= *walked_to) {
+        // Within the walk, anything it did not come across was deleted remotely
+        if (seen.contains(local[i].id)) {
+          fresh.push_back(std::move(local[i]));
+        }
+      } else {
+        // Past it, a torrent still in progress may have moved on without the walk seeing it
+        stale = stale || in_progress(local[i]);
+        fresh.push_back(std::move(local[i]));
+      }
+    }
+  }
+
+  // Anything deleted remotely further down (or a first sync) shows up as a count mismatch
+  if (known.empty() || fresh.size() != total || stale) {
+    auto everything = co_await fetch_all(loop, client, kind);
+    if (!everything) {
+      co_return std::nullopt;
+    }
+    stats.full_resync = true;
+    added = static_cast<size_t>(std::ranges::count_if(*everything, [&](const library::Entry& entry) { return !known.contains(entry.id); }));
+    fresh = std::move(*everything);
+  }
+  stats.added += added;
+  stats.updated += updated;
+  stats.total += fresh.size();
+  co_return fresh;
+}
+
+} // namespace
+
+std::optional<std::int64_t> library::parse_timestamp(std::string_view text) {
+  int fields[6] = {0, 0, 0, 0, 0, 0};
+  constexpr size_t field_count = std::size(fields);
+  size_t parsed = 0;
+  const char* position = text.data();
+  const char* end = text.data() + text.size();
+  while (parsed < field_count && position < end) {
+    auto [next, error] = std::from_chars(position, end, fields[parsed]);
+    if (error != std::errc{}) {
+      break;
+    }
+    ++parsed;
+    // Separators: '-' '-' 'T' ':' ':'
+    position = next < end ? next + 1 : next;
+  }
+  if (parsed != 3 && parsed != field_count) {
+    return std::nullopt;
+  }
+
+  std::chrono::year_month_day date{std::chrono::year{fields[0]}, std::chrono::month{static_cast<unsigned>(fields[1])},
+                                   std::chrono::day{static_cast<unsigned>(fields[2])}};
+  if (!date.ok()) {
+    return std::nullopt;
+  }
+  auto time = std::chrono::sys_days{date} + std::chrono::hours{fields[3]} + std::chrono::minutes{fields[4]} + std::chrono::seconds{fields[5]};
+  return static_cast<std::int64_t>(time.time_since_epoch().count());
+}
+
+std::string library::format_date(std::int64_t timestamp) {
+  auto days = std::chrono::floor<std::chrono::days>(std::chrono::sys_seconds{std::chrono::seconds{timestamp}});
+  std::chrono::year_month_day date{days};
+  return std::format("{:04}-{:02}-{:02}", static_cast<int>(date.year()), static_cast<unsigned>(date.month()), static_cast<unsigned>(date.day()));
+}
+
+library::Library::Library(fs::path path) : path(std::move(path)) {}
+
+void library::Library::close() {
+  mapping.reset();
+  record_count = 0;
+  records = {};
+  strings = {};
+}
+
+bool library::Library::open() {
+  close();
+  if (!fs::exists(path)) {
+    return true;
+  }
+  mapping.emplace(path.string());
+  if (!mapping->is_open()) {
+    return false;
+  }
+
+  auto contents = mapping->view();
+  Header header;
+  if (contents.size() < sizeof(header)) {
+    return false;
+  }
+  std::memcpy(&header, contents.data(), sizeof(header));
+  if (std::memcmp(header.magic, magic, sizeof(magic)) != 0 || header.version != format_version) {
+    logging::error("library", "Unrecognised library file, run --sync to rebuild it.");
+    return false;
+  }
+  if (header.byte_order != byte_order_mark) {
+    logging::error("library", "Library file was written with a different byte order, run --sync to rebuild it.");
+    return false;
+  }
+  if (header.record_count > (contents.size() - sizeof(header)) / sizeof(Record) || header.strings_offset > contents.size() ||
+      header.strings_size > contents.size() - header.strings_offset) {
+    logging::error("library", "Library file is truncated, run --sync to rebuild it.");
+    return false;
+  }
+
+  record_count = header.record_count;
+  records = contents.substr(sizeof(header), record_count * sizeof(Record));
+  strings = contents.substr(header.strings_offset, header.strings_size);
+  return true;
+}
+
+library::Entry library::Library::read_entry(size_t index) const {
+  Record record;
+  std::memcpy(&record, records.data() + index * sizeof(Record), sizeof(record));
+  return Entry{.kind = static_cast<Kind>(record.kind),
+               .id = std::string{resolve(strings, record.id)},
+               .name = std::string{resolve(strings, record.name)},
+               .hash = std::string{resolve(strings, record.hash)},
+               .status = std::string{resolve(strings, record.status)},
+               .link = std::string{resolve(strings, record.link)},
+               .bytes = record.bytes,
+               .added = record.added};
+}
+
+std::vector<library::Entry> library::Library::entries(Kind kind) const {
+  std::vector<Entry> result;
+  for (size_t i = 0; i < record_count; ++i) {
+    std::uint8_t record_kind;
+    std::memcpy(&record_kind, records.data() + i * sizeof(Record) + offsetof(Record, kind), sizeof(record_kind));
+    if (static_cast<Kind>(record_kind) == kind) {
+      result.push_back(read_entry(i));
+    }
+  }
+  return result;
+}
+
+std::vector<library::Entry> library::Library::find(const Query& query, size_t limit) const {
+  std::vector<Entry> matches;
+  for (size_t i = 0; i < record_count && matches.size() < limit; ++i) {
+    Record record;
+    std::memcpy(&record, records.data() + i * sizeof(Record), sizeof(record));
+
+    if (query.kind && static_cast<Kind>(record.kind) != *query.kind) {
+      continue;
+    }
+    if (record.added < query.since || record.added > query.until) {
+      continue;
+    }
+    if (!query.status.empty() && resolve(strings, record.status) != query.status) {
+      continue;
+    }
+    if (!query.text.empty() && !icontains(resolve(strings, record.name), query.text) && !resolve(strings, record.hash).starts_with(query.text) &&
+        resolve(strings, record.id) != query.text) {
+      continue;
+    }
+    matches.push_back(read_entry(i));
+  }
+  return matches;
+}
+
+bool library::Library::write(const std::vector<Entry>& torrents, const std::vector<Entry>& downloads) {
+  std::string string_table;
+  std::vector<Record> new_records;
+  new_records.reserve(torrents.size() + downloads.size());
+
+  auto intern = [&string_table](const std::string& text) {
+    StringRef ref{static_cast<std::uint32_t>(string_table.size()), static_cast<std::uint32_t>(text.size())};
+    string_table += text;
+    return ref;
+  };
+  for (const auto* list : {&torrents, &downloads}) {
+    for (const auto& entry : *list) {
+      Record record{};
+      record.id = intern(entry.id);
+      record.name = intern(entry.name);
+      record.hash = intern(entry.hash);
+      record.status = intern(entry.status);
+      record.link = intern(entry.link);
+      record.bytes = entry.bytes;
+      record.added = entry.added;
+      record.kind = static_cast<std::uint8_t>(entry.kind);
+      new_records.push_back(record);
+    }
+  }
+
+  Header header{};
+  std::memcpy(header.magic, magic, sizeof(magic));
+  header.version = format_version;
+  header.byte_order = byte_order_mark;
+  header.record_count = new_records.size();
+  header.strings_offset = sizeof(Header) + new_records.size() * sizeof(Record);
+  header.strings_size = string_table.size();
+
+  // One buffer, one write
+  std::string contents(header.strings_offset, '\0');
+  std::memcpy(contents.data(), &header, sizeof(header));
+  if (!new_records.empty()) {
+    std::memcpy(contents.data() + sizeof(header), new_records.data(), new_records.size() * sizeof(Record));
+  }
+  contents += string_table;
+
+  // Drop the old mapping before replacing the file underneath it. A failed write leaves the old file in place, which is mapped again
+  close();
+  bool written = util::write_file_atomically(path.string(), contents);
+  return open() && written;
+}
+
+async::Task<std::optional<library::SyncStats>> library::sync_async(async::EventLoop& loop, const api::RealDebridClient& client, Library& library) {
+  SyncStats stats;
+  auto torrents = co_await sync_kind(loop, client, Kind::Torrent, library.entries(Kind::Torrent), stats);
+  if (!torrents) {
+    co_return std::nullopt;
+  }
+  auto downloads = co_await sync_kind(loop, client, Kind::Download, library.entries(Kind::Download), stats);
+  if (!downloads) {
+    co_return std::nullopt;
+  }
+  if (!library.write(*torrents, *downloads)) {
+    co_return std::nullopt;
+  }
+  co_return stats;
+}
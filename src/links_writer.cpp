@@ -0,0 +1,152 @@
+#include "links_writer.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <format>
+#include <iterator>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Item {
+  std::string_view link;
+  std::string_view file; // empty when the name is only known once the download starts
+  std::uint64_t size;
+};
+
+// Pairs links with their files; a single link for several files is one packed archive
+std::vector<Item> collect_items(const api::Torrent& torrent) {
+  std::vector<Item> items;
+  items.reserve(torrent.links.size());
+  bool one_per_file = torrent.links.size() == torrent.files.size();
+  for (size_t i = 0; i < torrent.links.size(); ++i) {
+    if (one_per_file) {
+      items.push_back({torrent.links[i], torrent.files[i], i < torrent.file_sizes.size() ? torrent.file_sizes[i] : 0});
+    } else {
+      items.push_back({torrent.links[i], {}, 0});
+    }
+  }
+  return items;
+}
+
+// Segments worth opening for one file: no more than the profile allows, and none smaller than min-split-size
+size_t split_hint(std::uint64_t size, const aria2::TuningProfile& profile) {
+  auto segments = (size + profile.min_split_size - 1) / profile.min_split_size;
+  return std::clamp<size_t>(static_cast<size_t>(segments), 1, profile.split);
+}
+
+void append_xml_escaped(std::string& out, std::string_view text) {
+  for (char c : text) {
+    switch (c) {
+    case '&':
+      out += "&amp;";
+      break;
+    case '<':
+      out += "&lt;";
+      break;
+    case '>':
+      out += "&gt;";
+      break;
+    case '"':
+      out += "&quot;";
+      break;
+    default:
+      out += c;
+    }
+  }
+}
+
+std::string render_plain(const std::vector<Item>& items) {
+  std::string out;
+  for (const auto& item : items) {
+    out += item.link;
+    out += '\n';
+  }
+  return out;
+}
+
+std::string render_aria2(const std::vector<Item>& items, const std::string& dir, const aria2::TuningProfile& profile) {
+  // Option lines must be indented to belong to the URL above them
+  std::string out;
+  for (const auto& item : items) {
+    std::format_to(std::back_inserter(out), "{}\n  dir={}\n", item.link, dir);
+    if (!item.file.empty()) {
+      std::format_to(std::back_inserter(out), "  out={}\n", item.file);
+    }
+    if (item.size > 0) {
+      std::format_to(std::back_inserter(out), "  split={}\n", split_hint(item.size, profile));
+    }
+  }
+  return out;
+}
+
+std::string render_metalink(const std::vector<Item>& items, const api::Torrent& torrent) {
+  std::string out = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<metalink xmlns=\"urn:ietf:params:xml:ns:metalink\">\n";
+  for (const auto& item : items) {
+    out += "  <file name=\"";
+    append_xml_escaped(out, item.file.empty() ? std::string_view{torrent.name} : item.file);
+    out += "\">\n";
+    if (item.size > 0) {
+      std::format_to(std::back_inserter(out), "    <size>{}</size>\n", item.size);
+    }
+    out += "    <url>";
+    append_xml_escaped(out, item.link);
+    out += "</url>\n  </file>\n";
+  }
+  out += "</metalink>\n";
+  return out;
+}
+
+std::string render_json_lines(const std::vector<Item>& items, const api::Torrent& torrent) {
+  std::string out;
+  for (const auto& item : items) {
+    nlohmann::json line = {{"url", item.link}, {"file", item.file}, {"size", item.size}, {"torrent", torrent.id}};
+    out += line.dump();
+    out += '\n';
+  }
+  return out;
+}
+
+} // namespace
+
+std::optional<links_writer::Format> links_writer::parse_format(std::string_view name) {
+  if (name == "plain") {
+    return Format::Plain;
+  }
+  if (name == "aria2") {
+    return Format::Aria2;
+  }
+  if (name == "metalink") {
+    return Format::Metalink;
+  }
+  if (name == "jsonl") {
+    return Format::JsonLines;
+  }
+  return std::nullopt;
+}
+
+std::string_view links_writer::file_suffix(Format format) {
+  switch (format) {
+  case Format::Metalink:
+    return "_links.meta4";
+  case Format::JsonLines:
+    return "_links.jsonl";
+  default:
+    return "_links.txt";
+  }
+}
+
+std::string links_writer::render(Format format, const api::Torrent& torrent, const std::string& dir, const aria2::TuningProfile& profile) {
+  auto items = collect_items(torrent);
+  switch (format) {
+  case Format::Aria2:
+    return render_aria2(items, dir, profile);
+  case Format::Metalink:
+    return render_metalink(items, torrent);
+  case Format::JsonLines:
+    return render_json_lines(items, torrent);
+  default:
+    return render_plain(items);
+  }
+}
@@ -0,0 +1,269 @@
+#include "logging.hpp"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <format>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+
+struct Record {
+  std::int64_t time; // milliseconds since the epoch
+  logging::Level level;
+  bool truncated;
+  std::uint16_t length;
+  std::string_view module;
+  std::array<char, logging::max_message_length> text;
+};
+
+// Bounded multi-producer queue (Vyukov's): a slot's sequence number says whether it is free for the producer at that
+// position or holds a record for the consumer, so producers only contend on one atomic increment
+constexpr size_t capacity = 1024;
+
+struct Cell {
+  std::atomic<size_t> sequence;
+  Record record;
+};
+
+std::array<Cell, capacity> cells; // static, so nothing is allocated for them
+
+std::atomic<size_t> enqueue_position{0};
+size_t dequeue_position{0}; // writer thread only, then stop() once it has been joined
+std::atomic<size_t> dropped{0};
+
+logging::Format output_format{logging::Format::Human};
+int output_fd{2};
+std::atomic<bool> running{false};
+std::thread writer;
+std::mutex fallback_mutex;
+
+std::string_view level_name(logging::Level level) {
+  switch (level) {
+  case logging::Level::Debug:
+    return "debug";
+  case logging::Level::Info:
+    return "info";
+  case logging::Level::Warn:
+    return "warn";
+  case logging::Level::Error:
+    return "error";
+  default:
+    return "off";
+  }
+}
+
+void append_json_string(std::string& out, std::string_view text) {
+  out += '"';
+  for (char c : text) {
+    switch (c) {
+    case '"':
+      out += "\\\"";
+      break;
+    case '\\':
+      out += "\\\\";
+      break;
+    case '\n':
+      out += "\\n";
+      break;
+    case '\r':
+      out += "\\r";
+      break;
+    case '\t':
+      out += "\\t";
+      break;
+    default:
+      if (static_cast<unsigned char>(c) < 0x20) {
+        std::format_to(std::back_inserter(out), "\\u{:04x}", static_cast<unsigned>(c));
+      } else {
+        out += c;
+      }
+    }
+  }
+  out += '"';
+}
+
+void append_record(std::string& out, const Record& record) {
+  std::string_view message{record.text.data(), record.length};
+  // Trailing newlines were part of the old std::cerr messages; records are one line each
+  while (!message.empty() && message.back() == '\n') {
+    message.remove_suffix(1);
+  }
+
+  if (output_format == logging::Format::JsonLines) {
+    auto time = std::chrono::sys_time<std::chrono::milliseconds>{std::chrono::milliseconds{record.time}};
+    auto days = std::chrono::floor<std::chrono::days>(time);
+    std::chrono::year_month_day date{days};
+    std::chrono::hh_mm_ss clock{time - days};
+    std::format_to(std::back_inserter(out), R"({{"time":"{:04}-{:02}-{:02}T{:02}:{:02}:{:02}.{:03}Z","level":"{}","module":)",
+                   static_cast<int>(date.year()), static_cast<unsigned>(date.month()), static_cast<unsigned>(date.day()), clock.hours().count(),
+                   clock.minutes().count(), clock.seconds().count(), clock.subseconds().count(), level_name(record.level));
+    append_json_string(out, record.module);
+    out += R"(,"message":)";
+    append_json_string(out, message);
+    out += record.truncated ? ",\"truncated\":true}\n" : "}\n";
+    return;
+  }
+
+  // Human output reads like the plain messages did: "[aria2] Could not ...", flagged when it is a warning or an error
+  std::format_to(std::back_inserter(out), "[{}] ", record.module);
+  if (record.level == logging::Level::Warn) {
+    out += "warning: ";
+  } else if (record.level == logging::Level::Error) {
+    out += "error: ";
+  }
+  out += message;
+  out += record.truncated ? "...\n" : "\n";
+}
+
+void write_out(std::string_view data) {
+  while (!data.empty()) {
+#ifdef _WIN32
+    auto written = _write(output_fd, data.data(), static_cast<unsigned>(data.size()));
+#else
+    auto written = ::write(output_fd, data.data(), data.size());
+#endif
+    if (written <= 0) {
+      return; // nowhere left to report it
+    }
+    data.remove_prefix(static_cast<size_t>(written));
+  }
+}
+
+// Moves every queued record into `out`; false if there was none
+bool drain(std::string& out) {
+  bool any = false;
+  while (true) {
+    auto& cell = cells[dequeue_position % capacity];
+    if (cell.sequence.load(std::memory_order_acquire) != dequeue_position + 1) {
+      break;
+    }
+    append_record(out, cell.record);
+    cell.sequence.store(dequeue_position + capacity, std::memory_order_release);
+    ++dequeue_position;
+    any = true;
+  }
+  if (auto lost = dropped.exchange(0, std::memory_order_relaxed); lost > 0) {
+    std::format_to(std::back_inserter(out), "[logging] warning: {} record(s) dropped, the output could not keep up\n", lost);
+  }
+  return any;
+}
+
+void run_writer() {
+  std::string out;
+  out.reserve(64 * 1024);
+  while (running.load(std::memory_order_acquire)) {
+    if (!drain(out)) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+      continue;
+    }
+    write_out(out);
+    out.clear();
+  }
+  drain(out);
+  write_out(out);
+}
+
+// Without a writer (not started yet, or already stopped) a record goes out right away
+void write_synchronously(const Record& record) {
+  std::lock_guard lock(fallback_mutex);
+  std::string out;
+  append_record(out, record);
+  write_out(out);
+}
+
+} // namespace
+
+std::optional<logging::Level> logging::parse_level(std::string_view name) {
+  for (auto level : {Level::Debug, Level::Info, Level::Warn, Level::Error, Level::Off}) {
+    if (name == level_name(level)) {
+      return level;
+    }
+  }
+  return std::nullopt;
+}
+
+void logging::detail::push(Level level, std::string_view module, std::string_view message, bool truncated) noexcept {
+  Record record{std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count(),
+                level,
+                truncated,
+                static_cast<std::uint16_t>(message.size()),
+                module,
+                {}};
+  std::memcpy(record.text.data(), message.data(), message.size());
+
+  if (!running.load(std::memory_order_acquire)) {
+    write_synchronously(record);
+    return;
+  }
+
+  auto position = enqueue_position.load(std::memory_order_relaxed);
+  while (true) {
+    auto& cell = cells[position % capacity];
+    auto sequence = cell.sequence.load(std::memory_order_acquire);
+    auto difference = static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(position);
+    if (difference == 0) {
+      if (enqueue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+        cell.record = record;
+        cell.sequence.store(position + 1, std::memory_order_release);
+        return;
+      }
+    } else if (difference < 0) {
+      // Full: chatter is dropped, but warnings and errors wait for the writer to make room
+      if (level < Level::Warn) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+      }
+      // Once stop() has joined the writer nothing drains the ring any more
+      if (!running.load(std::memory_order_acquire)) {
+        write_synchronously(record);
+        return;
+      }
+      std::this_thread::yield();
+      position = enqueue_position.load(std::memory_order_relaxed);
+    } else {
+      position = enqueue_position.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+void logging::start(Level level, Format format, int fd) {
+  if (writer.joinable()) {
+    return;
+  }
+  detail::threshold.store(level, std::memory_order_relaxed);
+  output_format = format;
+  output_fd = fd;
+  for (size_t i = 0; i < capacity; ++i) {
+    cells[i].sequence.store(i, std::memory_order_relaxed);
+  }
+  running.store(true, std::memory_order_release);
+  writer = std::thread(run_writer);
+  std::atexit(stop);
+}
+
+void logging::stop() {
+  if (running.exchange(false, std::memory_order_acq_rel)) {
+    writer.join();
+    // Producers that saw the writer running may still be filling a slot they claimed after its last drain
+    std::string out;
+    while (dequeue_position != enqueue_position.load(std::memory_order_acquire)) {
+      if (!drain(out)) {
+        std::this_thread::yield();
+      }
+    }
+    drain(out);
+    write_out(out);
+  }
+}
@@ -0,0 +1,148 @@
+#include "magnet.hpp"
+#include <algorithm>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+constexpr std::string_view scheme{"magnet:?"};
+constexpr std::string_view btih_prefix{"urn:btih:"};
+
+bool iequals(std::string_view lhs, std::string_view rhs) {
+  return std::ranges::equal(lhs, rhs, [](char a, char b) { return (a | 0x20) == (b | 0x20); });
+}
+
+int hex_value(char c) {
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  c = static_cast<char>(c | 0x20);
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  return -1;
+}
+
+int base32_value(char c) {
+  if (c >= '2' && c <= '7')
+    return c - '2' + 26;
+  c = static_cast<char>(c | 0x20);
+  if (c >= 'a' && c <= 'z')
+    return c - 'a';
+  return -1;
+}
+
+bool decode_info_hash(std::string_view encoded, magnet::InfoHash& hash) {
+  if (encoded.size() == 40) {
+    for (size_t i = 0; i < hash.size(); ++i) {
+      int high = hex_value(encoded[2 * i]);
+      int low = hex_value(encoded[2 * i + 1]);
+      if (high < 0 || low < 0)
+        return false;
+      hash[i] = static_cast<std::uint8_t>(high << 4 | low);
+    }
+    return true;
+  }
+  if (encoded.size() == 32) {
+    // 32 base32 symbols carry exactly 160 bits
+    std::uint64_t bits = 0;
+    int bit_count = 0;
+    size_t out = 0;
+    for (char c : encoded) {
+      int value = base32_value(c);
+      if (value < 0)
+        return false;
+      bits = bits << 5 | static_cast<std::uint64_t>(value);
+      bit_count += 5;
+      if (bit_count >= 8) {
+        bit_count -= 8;
+        hash[out++] = static_cast<std::uint8_t>(bits >> bit_count);
+      }
+    }
+    return out == hash.size();
+  }
+  return false;
+}
+
+// Splits off the text up to the next separator (or the end)
+std::string_view next_token(std::string_view& text, char separator) {
+  auto position = text.find(separator);
+  auto token = text.substr(0, position);
+  text.remove_prefix(position == std::string_view::npos ? text.size() : position + 1);
+  return token;
+}
+
+std::string_view trim(std::string_view text) {
+  constexpr std::string_view whitespace{" \t\r\n"};
+  auto first = text.find_first_not_of(whitespace);
+  if (first == std::string_view::npos)
+    return {};
+  return text.substr(first, text.find_last_not_of(whitespace) - first + 1);
+}
+
+} // namespace
+
+std::string magnet::MagnetLink::hex_hash() const {
+  constexpr std::string_view digits{"0123456789abcdef"};
+  std::string hex(info_hash.size() * 2, '0');
+  for (size_t i = 0; i < info_hash.size(); ++i) {
+    hex[2 * i] = digits[info_hash[i] >> 4];
+    hex[2 * i + 1] = digits[info_hash[i] & 0x0f];
+  }
+  return hex;
+}
+
+std::optional<magnet::MagnetLink> magnet::parse(std::string_view uri) {
+  if (uri.size() < scheme.size() || !iequals(uri.substr(0, scheme.size()), scheme))
+    return std::nullopt;
+
+  MagnetLink link{.uri = uri, .info_hash = {}, .display_name = {}, .trackers = {}};
+  bool has_hash = false;
+
+  std::string_view query = uri.substr(scheme.size());
+  while (!query.empty()) {
+    std::string_view value = next_token(query, '&');
+    std::string_view key = next_token(value, '=');
+
+    // Numbered forms (xt.1, tr.2, ...) are allowed by the spec
+    key = key.substr(0, key.find('.'));
+    if (key == "xt") {
+      if (!has_hash && value.size() > btih_prefix.size() && iequals(value.substr(0, btih_prefix.size()), btih_prefix)) {
+        has_hash = decode_info_hash(value.substr(btih_prefix.size()), link.info_hash);
+      }
+    } else if (key == "dn") {
+      link.display_name = value;
+    } else if (key == "tr" && !value.empty()) {
+      link.trackers.push_back(value);
+    }
+  }
+
+  if (!has_hash)
+    return std::nullopt;
+  return link;
+}
+
+std::vector<magnet::MagnetLink> magnet::ingest(std::string_view contents, InfoHashSet& seen, IngestStats& stats) {
+  std::vector<MagnetLink> links;
+  auto line_estimate = static_cast<size_t>(std::ranges::count(contents, '\n')) + 1;
+  links.reserve(line_estimate);
+  seen.reserve(seen.size() + line_estimate);
+
+  while (!contents.empty()) {
+    std::string_view line = trim(next_token(contents, '\n'));
+    // Blank lines and comments don't count as entries
+    if (line.empty() || line.front() == '#')
+      continue;
+    ++stats.lines;
+
+    auto link = parse(line);
+    if (!link) {
+      ++stats.invalid;
+    } else if (!seen.insert(link->info_hash).second) {
+      ++stats.duplicates;
+    } else {
+      links.push_back(std::move(*link));
+    }
+  }
+  return links;
+}
@@ -1,116 +1,423 @@
+#include "admission.hpp"
 #include "api.hpp"
+#include "async.hpp"
 #include "aria2_manager.hpp"
+#include "concurrency.hpp"
+#include "content_index.hpp"
+#include "hoster.hpp"
+#include "library.hpp"
+#include "links_writer.hpp"
+#include "logging.hpp"
+#include "magnet.hpp"
+#include "monitor.hpp"
+#include "scheduler.hpp"
+#include "session.hpp"
 #include "shutdown_handler.hpp"
+#include "staging.hpp"
+#include "stream.hpp"
 #include "util.hpp"
+#include <algorithm>
 #include <cassert>
-#include <iostream>
+#include <deque>
+#include <filesystem>
 #include <optional>
 #include <print>
 #include <ranges>
 #include <thread>
 
-enum class AppState { ValidateMagnet, SendToAPI, WaitForConversion, DownloadFiles, MonitorDownloads, Finished, Error };
+enum class AppState {
+  ResumeDownloads,
+  ValidateMagnet,
+  CheckHosterLinks,
+  SendToAPI,
+  WaitForConversion,
+  NextHosterBatch,
+  UnrestrictLinks,
+  DownloadFiles,
+  MonitorDownloads,
+  Finished,
+  Error
+};
+
+// --sync and --search work on the local library only and skip the download pipeline
+int run_library_commands(const api::RealDebridClient& client, const util::Arguments& arguments) {
+  library::Library local_library;
+  if (!local_library.open() && !arguments.sync_flag) {
+    return 1;
+  }
+
+  if (arguments.sync_flag) {
+    logging::info("rddl", "Syncing torrents and downloads...");
+    async::EventLoop loop;
+    auto stats = loop.run(library::sync_async(loop, client, local_library));
+    if (!stats) {
+      logging::error("rddl", "Library sync failed.");
+      return 1;
+    }
+    logging::info("rddl", "{} new, {} updated, {} entries in total{}.", stats->added, stats->updated, stats->total,
+                  stats->full_resync ? " (full resync)" : "");
+  }
+
+  if (arguments.search) {
+    library::Query query{.text = *arguments.search, .status = arguments.status, .kind = std::nullopt, .since = 0, .until = INT64_MAX};
+    if (!arguments.since.empty()) {
+      if (auto since = library::parse_timestamp(arguments.since)) {
+        query.since = *since;
+      } else {
+        logging::error("rddl", "Invalid date: {}", arguments.since);
+        return 1;
+      }
+    }
+    for (const auto& entry : local_library.find(query, arguments.search_limit)) {
+      std::println("{}  {:<8} {:<9} {:<20} {}", library::format_date(entry.added), entry.kind == library::Kind::Torrent ? "torrent" : "download",
+                   entry.id, entry.status, entry.name);
+      if (!entry.link.empty()) {
+        std::println("            {}", entry.link);
+      }
+    }
+  }
+  return 0;
+}
 
 int main(int argc, char* argv[]) {
   shutdown_handler::register_handler();
 
   constexpr std::string default_output_path{"/tmp/"};
-  util::File links_file{default_output_path};
-  AppState state = AppState::ValidateMagnet;
+  std::deque<util::File> links_files;
 
-  std::string api_token{};
-  std::string magnet{};
-  bool links_flag;
-  std::string output_path{};
-  bool aria2_flag;
+  auto arguments = util::parse_arguments(argc, argv);
+  logging::start(logging::parse_level(arguments.log_level).value_or(logging::Level::Info),
+                 arguments.log_format == "json" ? logging::Format::JsonLines : logging::Format::Human);
 
-  std::tie(api_token, magnet, links_flag, output_path, aria2_flag) = util::parse_arguments(argc, argv);
+  api::ClientPool clients{util::get_rd_tokens(arguments.api_token)};
 
-  api_token = util::get_rd_token(api_token);
-  api::RealDebridClient client{api_token};
+  if (arguments.sync_flag || arguments.search) {
+    return run_library_commands(clients.primary(), arguments);
+  }
+
+  // Set up first, so that with stdout as the target nothing else gets printed into the stream
+  std::optional<int> stream_output;
+  if (arguments.stream_target) {
+    stream_output = stream::open_output(*arguments.stream_target);
+    if (!stream_output) {
+      return 1;
+    }
+  }
+  bool wants_links = arguments.links_flag || arguments.aria2_flag || stream_output;
 
   std::vector<api::Torrent> torrents;
 
+  // Unique magnets to process, viewing into `arguments.magnet` or the mapped magnet file; they are sent as the accounts'
+  // active torrent slots allow, and wait in `admitted` for their turn once on Real-Debrid
+  std::optional<util::MappedFile> magnet_list;
+  admission::Controller admission{clients};
+  std::deque<api::Torrent> admitted;
+  bool any_admitted{false};
+
+  // Live hoster links from --hoster-links, one pseudo-torrent per host, handled after the magnets
+  std::vector<api::Torrent> hoster_batches;
+  size_t next_hoster_batch{0};
+
+  auto next_torrent_state = [&] {
+    if (!admitted.empty() || !admission.empty()) {
+      return AppState::SendToAPI;
+    }
+    return next_hoster_batch < hoster_batches.size() ? AppState::NextHosterBatch : AppState::Finished;
+  };
+
   std::vector<util::FileDownloadProgress> files;
 
+  // With --lazy, files wait here and are unrestricted only shortly before aria2 gets to them
+  scheduler::LazyQueue lazy_queue{clients};
+  size_t download_slots{1};
+  // Downloads aria2 gave up on, across every torrent; any of them makes the run fail
+  size_t failed_downloads{0};
+
+  // Tunes slots and connections at runtime, unless --fixed
+  std::optional<concurrency::Controller> controller;
+  auto start_controller = [&](const aria2::TuningProfile& profile) {
+    if (!arguments.fixed_flag) {
+      auto downloads = std::clamp<size_t>(files.size() + lazy_queue.size(), 1, 16);
+      controller.emplace(concurrency::Limits{profile.max_concurrent_downloads, profile.max_connection_per_server},
+                         concurrency::Limits{downloads, 16});
+    }
+  };
+
+  // With --staging, finished files move from the staging directory into the download directory while the rest download
+  staging::Finalizer finalizer;
+  auto finalize = [&](const util::FileDownloadProgress& file) {
+    std::filesystem::path file_dir = file.get_options().value("dir", "");
+    auto final_dir = std::filesystem::absolute(aria2::download_dir);
+    if (file_dir.empty() || file_dir == final_dir) {
+      return;
+    }
+    for (const auto& path : aria2::rpc_get_file_paths(file.get_gid())) {
+      // Keeps the layout aria2 wrote, i.e. the torrent's own paths from `out`
+      auto relative = std::filesystem::path{path}.lexically_relative(file_dir);
+      if (!relative.empty() && *relative.begin() != "..") {
+        finalizer.submit(path, final_dir / relative);
+      }
+    }
+  };
+
+  content_index::ContentIndex local_index{aria2::download_dir};
+  local_index.load();
+  std::vector<std::string> indexed_files;
+
+  // Downloads paused by an interrupted run go first
+  std::optional<session::State> paused_session = arguments.aria2_flag ? session::load() : std::nullopt;
+  bool resuming{false};
+  AppState state = paused_session ? AppState::ResumeDownloads : AppState::ValidateMagnet;
+
   std::print("\033[?25l"); // hide cursor
 
   // Process loop
   while (!shutdown_handler::shutdown_requested && state != AppState::Finished && state != AppState::Error) {
     switch (state) {
-    case AppState::ValidateMagnet: {
-      if (!util::validate_magnet_link(magnet)) {
-        std::cerr << "Invalid magnet link." << std::endl;
+    case AppState::ResumeDownloads: {
+      logging::info("rddl", "Resuming {} download(s) paused by an earlier run...", paused_session->downloads.size() + paused_session->pending.size());
+      download_slots = paused_session->slots;
+      indexed_files = paused_session->indexed_files;
+      auto profile = aria2::derive_tuning_profile(download_slots, {});
+      if (!aria2::launch_aria2_daemon(profile)) {
+        logging::error("rddl", "Timed out waiting for aria2 daemon to start.");
         state = AppState::Error;
-      } else {
-        state = AppState::SendToAPI;
+        break;
       }
+      session::resume(*paused_session, files, lazy_queue);
+      session::discard();
+      lazy_queue.fill(files, download_slots);
+      start_controller(profile);
+      resuming = true;
+      state = files.empty() ? AppState::ValidateMagnet : AppState::MonitorDownloads;
       break;
     }
 
-    case AppState::SendToAPI: {
-      // Check if torrent has been sucessfully sent to Real-Debrid
-      // Place it into the vector if so
-      if (auto torrent = client.send_magnet_link(magnet)) {
-        torrents.emplace_back(*torrent);
-      } else {
-        state = AppState::Error;
-      }
-      if (!links_flag && !aria2_flag) {
+    case AppState::ValidateMagnet: {
+      if (arguments.magnet.empty() && arguments.magnet_file.empty() && arguments.hoster_file.empty()) {
+        // Nothing but paused downloads to resume
         state = AppState::Finished;
-      } else {
-        state = AppState::WaitForConversion;
+        break;
+      }
+      // Dedupe on the normalised info hash, so no API call is spent on repeats
+      magnet::InfoHashSet seen;
+      std::vector<magnet::MagnetLink> magnets;
+      if (!arguments.magnet.empty()) {
+        if (auto link = magnet::parse(arguments.magnet)) {
+          seen.insert(link->info_hash);
+          magnets.push_back(std::move(*link));
+        } else {
+          logging::error("rddl", "Invalid magnet link.");
+          state = AppState::Error;
+          break;
+        }
+      }
+      if (!arguments.magnet_file.empty()) {
+        magnet_list.emplace(arguments.magnet_file);
+        if (!magnet_list->is_open()) {
+          logging::error("rddl", "Could not read magnet file: {}", arguments.magnet_file);
+          state = AppState::Error;
+          break;
+        }
+        magnet::IngestStats stats;
+        std::ranges::move(magnet::ingest(magnet_list->view(), seen, stats), std::back_inserter(magnets));
+        logging::info("rddl", "Read {} magnet link(s): {} invalid, {} duplicate(s) skipped.", stats.lines, stats.invalid, stats.duplicates);
+      }
+      admission.enqueue(std::move(magnets));
+      state = AppState::CheckHosterLinks;
+      break;
+    }
+
+    case AppState::CheckHosterLinks: {
+      if (!arguments.hoster_file.empty()) {
+        util::MappedFile hoster_list{arguments.hoster_file};
+        if (!hoster_list.is_open()) {
+          logging::error("rddl", "Could not read hoster link file: {}", arguments.hoster_file);
+          state = AppState::Error;
+          break;
+        }
+        hoster::IngestStats stats;
+        auto links = hoster::ingest(hoster_list.view(), stats);
+        logging::info("rddl", "Read {} hoster link(s): {} invalid, {} duplicate(s) skipped.", stats.lines, stats.invalid, stats.duplicates);
+
+        // Weed out dead links before any of them costs an unrestrict
+        logging::info("rddl", "Checking {} link(s)...", links.size());
+        auto checked = clients.check_links(links);
+        std::vector<api::LinkInfo> live_links;
+        for (auto&& [link, check] : std::views::zip(links, checked)) {
+          if (check.info) {
+            live_links.push_back(std::move(*check.info));
+          } else if (check.dead) {
+            logging::warn("rddl", "{} is dead or unsupported, skipping.", link);
+          } else {
+            // Not known to be dead, so it still gets its unrestrict
+            logging::warn("rddl", "{} could not be checked, keeping it.", link);
+            live_links.push_back(api::LinkInfo{link, "", "", 0});
+          }
+        }
+        hoster_batches = hoster::group_by_host(live_links);
+        for (const auto& batch : hoster_batches) {
+          logging::info("rddl", "{}: {} live link(s), {} MiB", batch.name, batch.links.size(), batch.size / (1024 * 1024));
+        }
+      }
+      state = admission.empty() && hoster_batches.empty() ? AppState::Error : next_torrent_state();
+      break;
+    }
+
+    case AppState::SendToAPI: {
+      // Top up the accounts' free slots, waiting for one to free up only when nothing sent earlier is left to process
+      // (wait_and_admit() tries right away, so it alone costs one round of active counts when nothing is free)
+      std::ranges::move(admitted.empty() ? admission.wait_and_admit() : admission.admit(), std::back_inserter(admitted));
+      if (admitted.empty()) {
+        // Every remaining magnet was refused; carry on with whatever else there is
+        state = any_admitted || !hoster_batches.empty() ? next_torrent_state() : AppState::Error;
+        break;
       }
+      any_admitted = true;
+      torrents.push_back(std::move(admitted.front()));
+      admitted.pop_front();
+      state = wants_links ? AppState::WaitForConversion : next_torrent_state();
       break;
     }
 
     case AppState::WaitForConversion: {
       auto& torrent = torrents.back();
-      if (client.wait_for_status(torrent.id, "downloaded", torrent.size)) {
-        std::println("Caching complete! Obtaining unrestricted download links...");
-        torrent.links = client.get_download_links(torrent.links);
-        links_file.append_file_name_to_path(torrent.name, output_path);
-        if (links_file.create_text_file(torrent.links)) {
-          state = AppState::DownloadFiles;
-          break;
+      if (clients.wait_for_status(torrent.id, "downloaded", torrent.size)) {
+        logging::info("rddl", "Caching complete!");
+        state = AppState::UnrestrictLinks;
+        break;
+      }
+      logging::error("rddl", "Timed out waiting for status: downloaded.");
+      state = AppState::Error;
+      break;
+    }
+
+    case AppState::NextHosterBatch: {
+      auto& batch = torrents.emplace_back(std::move(hoster_batches[next_hoster_batch++]));
+      logging::info("rddl", "Processing {} link(s) from {}...", batch.links.size(), batch.name);
+      state = wants_links ? AppState::UnrestrictLinks : next_torrent_state();
+      break;
+    }
+
+    case AppState::UnrestrictLinks: {
+      auto& torrent = torrents.back();
+      if (arguments.lazy_flag) {
+        // Links stay restricted until the download scheduler needs them
+        state = AppState::DownloadFiles;
+        break;
+      }
+      logging::info("rddl", "Obtaining unrestricted download links...");
+      // Links that failed are dropped together with their file, so every later link keeps its own name and size
+      auto unrestricted = clients.get_download_links(torrent.links);
+      bool one_per_file = torrent.links.size() == torrent.files.size();
+      api::Torrent kept{torrent.id, torrent.name, {}, {}, {}, torrent.size};
+      for (size_t i = 0; i < unrestricted.size(); ++i) {
+        if (!unrestricted[i]) {
+          logging::warn("rddl", "Could not unrestrict {}, skipping it.", one_per_file ? torrent.files[i] : torrent.links[i]);
+          continue;
+        }
+        kept.links.push_back(std::move(*unrestricted[i]));
+        if (one_per_file) {
+          kept.files.push_back(torrent.files[i]);
+          kept.file_sizes.push_back(i < torrent.file_sizes.size() ? torrent.file_sizes[i] : 0);
         }
       }
-      std::cerr << "Timed out waiting for status: downloaded." << std::endl;
+      if (kept.links.empty()) {
+        logging::error("rddl", "None of the links could be unrestricted.");
+        state = AppState::Error;
+        break;
+      }
+      if (!one_per_file) {
+        kept.files = std::move(torrent.files);
+        kept.file_sizes = std::move(torrent.file_sizes);
+      }
+      torrent = std::move(kept);
+      auto format = links_writer::parse_format(arguments.format).value_or(links_writer::Format::Plain);
+      auto& links_file = links_files.emplace_back(default_output_path);
+      links_file.append_file_name_to_path(torrent.name, arguments.output_path, links_writer::file_suffix(format));
+      auto contents = links_writer::render(format, torrent, std::filesystem::absolute(aria2::download_dir).string(),
+                                           aria2::derive_tuning_profile(torrent.links.size(), torrent.file_sizes));
+      if (links_file.create_text_file(contents)) {
+        state = AppState::DownloadFiles;
+        break;
+      }
+      logging::error("rddl", "Could not write the links file.");
       state = AppState::Error;
       break;
     }
 
     case AppState::DownloadFiles: {
-      if (links_flag) {
+      if (arguments.links_flag) {
         auto& torrent = torrents.back();
         std::println("\nDownload link(s):");
         for (auto& link : torrent.links) {
           std::println("{}", link);
         }
-        state = AppState::Finished;
+        state = next_torrent_state();
       }
-      if (aria2_flag) {
-        if (aria2::launch_aria2_daemon()) {
+      if (stream_output) {
+        auto& torrent = torrents.back();
+        for (size_t i = 0; i < torrent.links.size(); ++i) {
+          // A single link for several files is a packed archive, named after the torrent
+          const auto& name = torrent.links.size() == torrent.files.size() ? torrent.files[i] : torrent.name;
+          logging::info("rddl", "Streaming {}...", name);
+          if (!stream::pipe_url(torrent.links[i], *stream_output)) {
+            logging::error("rddl", "Streaming {} failed.", name);
+            state = AppState::Error;
+            break;
+          }
+        }
+        if (state != AppState::Error) {
+          state = next_torrent_state();
+        }
+      }
+      if (arguments.aria2_flag) {
+        auto& torrent = torrents.back();
+        files.clear();
+        indexed_files.clear();
+        auto profile = aria2::derive_tuning_profile(torrent.links.size(), torrent.file_sizes);
+        download_slots = profile.max_concurrent_downloads;
+        if (aria2::launch_aria2_daemon(profile)) {
           try {
-            std::println("\nSuccessfully started aria2 daemon.\n");
-            auto& torrent = torrents.back();
-            if (torrent.links.size() == 1) {
-              files.emplace_back(util::FileDownloadProgress(torrent.links.back(), torrent.name));
+            logging::info("rddl", "Successfully started aria2 daemon.");
+            auto download_dir = std::filesystem::absolute(aria2::download_dir).string();
+            auto target_dir = arguments.staging_dir.empty() ? download_dir : std::filesystem::absolute(arguments.staging_dir).string();
+            auto add_download = [&](const std::string& link, const std::string& name, const nlohmann::json& options) {
+              if (arguments.lazy_flag) {
+                lazy_queue.push({link, name, options});
+              } else {
+                files.emplace_back(util::FileDownloadProgress(link, name, options));
+              }
+            };
+            if (torrent.links.size() == 1 && torrent.files.size() != 1) {
+              // Packed into a single archive, whose name is only known once the download starts
+              add_download(torrent.links.back(), torrent.name, {{"dir", target_dir}});
             } else {
-              // assert(torrent.links.size() == torrent.files.size());
-              for (auto&& [link, file] : std::views::zip(torrent.links, torrent.files)) {
-                files.emplace_back(util::FileDownloadProgress(link, file));
+              // Skip whatever an earlier run (or an overlapping torrent) already left in the download directory
+              local_index.refresh(torrent.files);
+              for (auto&& [link, file, file_size] : std::views::zip(torrent.links, torrent.files, torrent.file_sizes)) {
+                if (local_index.is_present(file, file_size)) {
+                  logging::info("rddl", "{} is already downloaded, skipping.", file);
+                  continue;
+                }
+                indexed_files.push_back(file);
+                add_download(link, file, {{"dir", target_dir}, {"out", file}});
               }
             }
-            if (state != AppState::Error) {
+            lazy_queue.fill(files, download_slots);
+            if (files.empty()) {
+              logging::info("rddl", "All files are already present in {}.", download_dir);
+              state = next_torrent_state();
+            } else if (state != AppState::Error) {
+              start_controller(profile);
               state = AppState::MonitorDownloads;
             }
           } catch (const std::exception& e) {
-            std::println("Skipping downloads...");
+            logging::error("rddl", "Skipping downloads: {}", e.what());
             state = AppState::Error;
           }
         } else {
-          std::cerr << "Timed out waiting for aria2 daemon to start." << std::endl;
+          logging::error("rddl", "Timed out waiting for aria2 daemon to start.");
           state = AppState::Error;
         }
       }
@@ -118,39 +425,55 @@ int main(int argc, char* argv[]) {
     }
 
     case AppState::MonitorDownloads: {
-      size_t total_downloads{files.size()};
       size_t completed_downloads{0};
-      auto max_length =
-          std::ranges::max(files | std::views::transform([](const util::FileDownloadProgress& file) { return file.get_name().length(); }));
+      size_t torrent_failures{0};
+      auto max_length = std::max(
+          std::ranges::max(files | std::views::transform([](const util::FileDownloadProgress& file) { return file.get_name().length(); })),
+          lazy_queue.longest_name());
       size_t bar_length = 40;
+      // Slots freed while these files download are filled right away, so the next torrents cache in the meantime
+      auto next_admission = std::chrono::steady_clock::now() + std::chrono::minutes(2);
 
       while (!shutdown_handler::shutdown_requested) {
-        for (auto& file : files) {
-          if (auto parsed_response = aria2::rpc_get_status(file.get_gid())) {
-            auto& parsed_json = (*parsed_response);
-            if (parsed_json.contains("result")) {
-              if (const auto& total_individual_length = std::stol(parsed_json["result"]["totalLength"].get<std::string>());
-                  total_individual_length != 0) {
-                auto current_individual_length = std::stof(parsed_json["result"]["completedLength"].get<std::string>());
-                file.set_progress(current_individual_length / total_individual_length);
-                if (file.get_progress() >= 1.0f && !file.get_completion_status()) {
-                  file.mark_completed();
-                  completed_downloads += 1;
-                  std::println("{:<{}} Completed!", file.get_name(), max_length + bar_length);
-                }
-              }
-            }
+        auto tick = monitor::poll(files, lazy_queue, max_length + bar_length);
+        completed_downloads += tick.completed;
+        torrent_failures += tick.failed;
+        for (auto index : tick.finished) {
+          finalize(files[index]);
+        }
+
+        if (controller) {
+          for (const auto& link : tick.congested_links) {
+            controller->observe_error(hoster::host_of(link).value_or(""));
+          }
+          if (auto stat = aria2::rpc_get_global_stat()) {
+            controller->observe_speed(stat->download_speed);
+          }
+          if (auto adjustment = controller->step()) {
+            concurrency::apply(*adjustment, files);
+            download_slots = adjustment->limits.slots;
           }
         }
 
+        lazy_queue.fill(files, download_slots);
+
+        if (!admission.empty() && std::chrono::steady_clock::now() >= next_admission) {
+          std::ranges::move(admission.admit(), std::back_inserter(admitted));
+          next_admission = std::chrono::steady_clock::now() + std::chrono::minutes(2);
+        }
+
         auto active_count = std::ranges::count_if(
             files, [](const util::FileDownloadProgress& file) { return file.get_progress() != 0 && !file.get_completion_status(); });
 
         util::print_progress_bar(files, max_length, bar_length);
         std::this_thread::sleep_for(std::chrono::milliseconds(200));
 
-        if (completed_downloads == total_downloads) {
-          std::println("\n\nDownload(s) complete!");
+        if (completed_downloads + torrent_failures == files.size() && lazy_queue.empty()) {
+          if (torrent_failures > 0) {
+            logging::error("rddl", "{} of {} download(s) failed.", torrent_failures, files.size());
+          } else {
+            logging::info("rddl", "Download(s) complete!");
+          }
           break;
         }
 
@@ -159,7 +482,22 @@ int main(int argc, char* argv[]) {
         }
       }
 
-      state = AppState::Finished;
+      failed_downloads += torrent_failures;
+      if (shutdown_handler::shutdown_requested) {
+        // Queued moves and the index are seen to once aria2 is paused, below
+        break;
+      }
+      if (auto totals = finalizer.wait(); totals.moved + totals.failed > 0) {
+        logging::info("rddl", "Moved {} file(s) into {} ({} across filesystems), {} failed.", totals.moved, aria2::download_dir,
+                      totals.copied, totals.failed);
+      }
+
+      // Record what finished (and what is still partial) for the next run
+      local_index.refresh(indexed_files);
+      local_index.save();
+
+      state = resuming ? AppState::ValidateMagnet : next_torrent_state();
+      resuming = false;
       break;
     }
 
@@ -168,16 +506,31 @@ int main(int argc, char* argv[]) {
     }
   }
   if (shutdown_handler::shutdown_requested) {
-    std::println("\nProcess terminated gracefully and successfully.");
+    if (arguments.aria2_flag) {
+      auto pending = lazy_queue.size();
+      if (auto paused = session::pause_and_persist(files, lazy_queue, indexed_files, download_slots); paused > 0 || pending > 0) {
+        logging::info("rddl", "Paused {} download(s) ({} not started yet); run again with -a or --resume to continue.", paused, pending);
+      }
+      if (auto totals = finalizer.wait(); totals.moved + totals.failed > 0) {
+        logging::info("rddl", "Moved {} finished file(s) into {}, {} failed.", totals.moved, aria2::download_dir, totals.failed);
+      }
+      local_index.refresh(indexed_files);
+      local_index.save();
+    }
+    logging::info("rddl", "Process terminated gracefully and successfully.");
+    std::print("\033[?25h");
+    return 1;
+  } else if (state == AppState::Finished && failed_downloads > 0) {
+    logging::error("rddl", "Process finished, but {} download(s) failed.", failed_downloads);
     std::print("\033[?25h");
     return 1;
   } else if (state == AppState::Finished) {
-    std::println("\nProcess executed successfully.");
+    logging::info("rddl", "Process executed successfully.");
     std::print("\033[?25h");
     return 0;
   } else if (state == AppState::Error) {
-    std::println("Something wrong went unconsidered. Please report the problem as descriptively as possible on GitHub.");
-    std::println("https://github.com/greppetto/real-debrid-download-helper");
+    logging::error("rddl", "Something wrong went unconsidered. Please report the problem as descriptively as possible on GitHub: "
+                           "https://github.com/greppetto/real-debrid-download-helper");
     std::print("\033[?25h");
     return 1;
   }
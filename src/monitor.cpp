@@ -0,0 +1,58 @@
+#include "monitor.hpp"
+#include "aria2_manager.hpp"
+#include "logging.hpp"
+#include <print>
+#include <string>
+
+monitor::TickStats monitor::poll(std::vector<util::FileDownloadProgress>& files, scheduler::LazyQueue& lazy_queue, size_t label_width) {
+  TickStats stats;
+  // Finished and failed files keep their last state, the rest are asked about in a single multicall
+  std::vector<size_t> pending;
+  std::vector<std::string> gids;
+  for (size_t index = 0; index < files.size(); ++index) {
+    if (!files[index].get_completion_status()) {
+      pending.push_back(index);
+      gids.push_back(files[index].get_gid());
+    }
+  }
+  if (gids.empty()) {
+    return stats;
+  }
+  ++stats.rpc_calls;
+  auto statuses = aria2::rpc_get_statuses(gids);
+
+  for (size_t i = 0; i < pending.size(); ++i) {
+    if (!statuses[i]) {
+      continue;
+    }
+    auto index = pending[i];
+    auto& file = files[index];
+    auto& status = *statuses[i];
+    if (status.value("status", "") == "error") {
+      // Expired or failed URLs get a fresh link when they were scheduled lazily
+      auto error_code = std::stoi(status.value("errorCode", "0"));
+      if (aria2::is_congestion_error(error_code)) {
+        stats.congested_links.push_back(file.get_link());
+      }
+      if (!aria2::is_link_error(error_code) || !lazy_queue.retry(file)) {
+        file.mark_completed();
+        stats.failed += 1;
+        logging::warn("monitor", "{} failed (aria2 error {})", file.get_name(), error_code);
+      }
+      continue;
+    }
+    if (const auto& total_individual_length = std::stol(status["totalLength"].get<std::string>()); total_individual_length != 0) {
+      auto current_individual_length = std::stof(status["completedLength"].get<std::string>());
+      file.set_progress(current_individual_length / static_cast<float>(total_individual_length));
+    }
+    // Only "complete" means aria2 has flushed and closed the file, which matters once it gets moved elsewhere
+    if (status.value("status", "") == "complete") {
+      file.set_progress(1.0f);
+      file.mark_completed();
+      stats.completed += 1;
+      stats.finished.push_back(index);
+      std::println("{:<{}} Completed!", file.get_name(), label_width);
+    }
+  }
+  return stats;
+}
@@ -0,0 +1,66 @@
+#include "scheduler.hpp"
+#include "async.hpp"
+#include "logging.hpp"
+#include <algorithm>
+#include <exception>
+#include <optional>
+#include <string>
+#include <vector>
+
+scheduler::LazyQueue::LazyQueue(api::ClientPool& clients, size_t lookahead, size_t max_restarts)
+    : clients(clients), lookahead(lookahead), max_restarts(max_restarts) {}
+
+void scheduler::LazyQueue::push(PendingFile file) {
+  pending.push_back(std::move(file));
+}
+
+void scheduler::LazyQueue::fill(std::vector<util::FileDownloadProgress>& files, size_t slots) {
+  auto unfinished =
+      static_cast<size_t>(std::ranges::count_if(files, [](const util::FileDownloadProgress& file) { return !file.get_completion_status(); }));
+  size_t wanted = std::min(slots + lookahead - std::min(unfinished, slots + lookahead), pending.size());
+  if (wanted == 0) {
+    return;
+  }
+
+  // Unrestrict the whole batch concurrently; each account's rate limiter spaces out its share
+  std::vector<PendingFile> batch;
+  std::vector<async::Task<std::optional<std::string>>> tasks;
+  async::EventLoop loop;
+  for (size_t i = 0; i < wanted; ++i) {
+    batch.push_back(std::move(pending.front()));
+    pending.pop_front();
+    tasks.push_back(clients.unrestrict_async(loop, batch.back().source));
+  }
+  auto links = loop.run(async::gather(std::move(tasks)));
+
+  for (size_t i = 0; i < batch.size(); ++i) {
+    if (!links[i]) {
+      logging::warn("scheduler", "Skipping {}, its link could not be unrestricted.", batch[i].name);
+      continue;
+    }
+    try {
+      auto& file = files.emplace_back(*links[i], batch[i].name, batch[i].options);
+      file.set_source(std::move(batch[i].source));
+    } catch (const std::exception& e) {
+      logging::warn("scheduler", "Skipping {}.", batch[i].name);
+    }
+  }
+}
+
+bool scheduler::LazyQueue::retry(util::FileDownloadProgress& file) {
+  if (file.get_source().empty() || file.get_restarts() >= max_restarts) {
+    return false;
+  }
+  logging::info("scheduler", "Link for {} failed, unrestricting it again...", file.get_name());
+  async::EventLoop loop;
+  auto link = loop.run(clients.unrestrict_async(loop, file.get_source()));
+  return link && file.restart(*link);
+}
+
+size_t scheduler::LazyQueue::longest_name() const noexcept {
+  size_t longest = 0;
+  for (const auto& file : pending) {
+    longest = std::max(longest, file.name.length());
+  }
+  return longest;
+}
@@ -0,0 +1,122 @@
+#include "session.hpp"
+#include "logging.hpp"
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+using json = nlohmann::json;
+
+std::optional<session::State> session::load(const std::string& path) {
+  std::ifstream file(path);
+  if (!file) {
+    return std::nullopt;
+  }
+  std::stringstream buffer;
+  buffer << file.rdbuf();
+
+  State state;
+  try {
+    auto parsed_json = json::parse(buffer.str());
+    for (const auto& download : parsed_json.at("downloads")) {
+      state.downloads.push_back({download.at("gid").get<std::string>(), download.value("link", std::string{}), download.at("name").get<std::string>(),
+                                 download.value("source", std::string{}), download.value("options", json::object())});
+    }
+    for (const auto& pending : parsed_json.value("pending", json::array())) {
+      state.pending.push_back(
+          {pending.at("source").get<std::string>(), pending.at("name").get<std::string>(), pending.value("options", json::object())});
+    }
+    state.indexed_files = parsed_json.value("indexed_files", std::vector<std::string>{});
+    state.slots = parsed_json.value("slots", size_t{1});
+  } catch (const json::exception& e) {
+    logging::warn("session", "Ignoring unreadable {}: {}", path, e.what());
+    return std::nullopt;
+  }
+  return state;
+}
+
+bool session::save(const State& state, const std::string& path) {
+  json downloads = json::array();
+  for (const auto& download : state.downloads) {
+    downloads.push_back(
+        {{"gid", download.gid}, {"link", download.link}, {"name", download.name}, {"source", download.source}, {"options", download.options}});
+  }
+  json pending = json::array();
+  for (const auto& file : state.pending) {
+    pending.push_back({{"source", file.source}, {"name", file.name}, {"options", file.options}});
+  }
+  json contents = {{"downloads", downloads}, {"pending", pending}, {"indexed_files", state.indexed_files}, {"slots", state.slots}};
+  return util::write_file_atomically(path, contents.dump(2));
+}
+
+void session::discard(const std::string& path) {
+  std::error_code error;
+  std::filesystem::remove(path, error);
+}
+
+size_t session::pause_and_persist(const std::vector<util::FileDownloadProgress>& files, const scheduler::LazyQueue& lazy_queue,
+                                  const std::vector<std::string>& indexed_files, size_t slots) {
+  State state{{}, {lazy_queue.get_pending().begin(), lazy_queue.get_pending().end()}, indexed_files, slots};
+  std::vector<std::string> gids;
+  for (const auto& file : files) {
+    if (!file.get_completion_status()) {
+      state.downloads.push_back({file.get_gid(), file.get_link(), file.get_name(), file.get_source(), file.get_options()});
+      gids.push_back(file.get_gid());
+    }
+  }
+  if (state.downloads.empty() && state.pending.empty()) {
+    return 0;
+  }
+
+  // Pause rather than remove, so the partial files and aria2's control files stay usable
+  auto paused = aria2::rpc_pause_downloads(gids);
+  if (!aria2::rpc_save_session()) {
+    logging::warn("aria2", "Could not save the aria2 session.");
+  }
+  if (!save(state)) {
+    logging::error("session", "Could not save {}", state_file);
+  }
+  return paused;
+}
+
+void session::resume(const State& state, std::vector<util::FileDownloadProgress>& files, scheduler::LazyQueue& lazy_queue) {
+  std::vector<std::string> gids;
+  for (const auto& download : state.downloads) {
+    gids.push_back(download.gid);
+  }
+  auto resumed = aria2::rpc_unpause_downloads(gids);
+  std::unordered_set<std::string> known(resumed.begin(), resumed.end());
+
+  for (const auto& download : state.downloads) {
+    bool alive = known.contains(download.gid);
+    if (!alive) {
+      // Not paused (the pause may never have reached aria2), but possibly still there
+      if (auto parsed_response = aria2::rpc_get_status(download.gid); parsed_response && parsed_response->contains("result")) {
+        auto status = (*parsed_response)["result"].value("status", std::string{});
+        alive = status == "active" || status == "waiting" || status == "paused" || status == "complete";
+      }
+    }
+
+    if (alive) {
+      auto& file = files.emplace_back(util::FileDownloadProgress::adopt(download.gid, download.link, download.name, download.options));
+      file.set_source(download.source);
+    } else if (!download.source.empty()) {
+      lazy_queue.push({download.source, download.name, download.options});
+    } else {
+      // aria2 lost track of it; continue=true picks the partial file up again
+      auto options = download.options;
+      options["continue"] = "true";
+      try {
+        files.emplace_back(download.link, download.name, options);
+      } catch (const std::exception& e) {
+        logging::warn("aria2", "Could not resume {}.", download.name);
+      }
+    }
+  }
+  for (const auto& pending : state.pending) {
+    lazy_queue.push(pending);
+  }
+}
@@ -1,10 +1,16 @@
 #include "shutdown_handler.hpp"
+#include "logging.hpp"
 #include <atomic>
+#include <cstdlib>
 #include <iostream>
 #ifdef _WIN32
 #include <windows.h>
 #else
+#include <cerrno>
 #include <csignal>
+#include <fcntl.h>
+#include <thread>
+#include <unistd.h>
 #endif
 
 std::atomic<bool> shutdown_handler::shutdown_requested{false};
@@ -12,7 +18,11 @@ std::atomic<bool> shutdown_handler::shutdown_requested{false};
 #ifdef _WIN32
 BOOL WINAPI shutdown_handler::console_handler(DWORD signal) {
   if (signal == CTRL_C_EVENT || signal == CTRL_CLOSE_EVENT) {
-    shutdown_handler::shutdown_requested = true;
+    // Runs on its own thread, so reporting from here is fine
+    if (shutdown_requested.exchange(true)) {
+      std::_Exit(130);
+    }
+    logging::warn("shutdown", "Shutdown requested, pausing downloads...");
     return TRUE;
   }
   return FALSE;
@@ -22,15 +32,63 @@ void shutdown_handler::register_handler() {
   SetConsoleCtrlHandler(console_handler, TRUE);
 }
 #else
-void shutdown_handler::handle_signal(int signal) {
-  if (signal == SIGINT || signal == SIGTERM) {
-    std::cerr << "\nShutdown requested, beginning clean up...\n";
-    shutdown_requested = true;
+namespace {
+
+// Self-pipe: the handler writes the signal number, the watcher thread reads it outside signal context
+int signal_pipe[2]{-1, -1};
+
+void watch_signals() {
+  unsigned char signal;
+  size_t received = 0;
+  while (true) {
+    auto result = read(signal_pipe[0], &signal, 1);
+    if (result < 0 && errno == EINTR) {
+      continue;
+    }
+    if (result <= 0) {
+      return;
+    }
+    if (++received == 1) {
+      logging::warn("shutdown", "Shutdown requested, pausing downloads... (press Ctrl+C again to quit immediately)");
+    } else {
+      // Straight to stderr, _Exit leaves no time for the log writer
+      std::cerr << "\nForced exit, downloads were left as they are.\n";
+      std::_Exit(128 + signal);
+    }
   }
 }
 
+} // namespace
+
+void shutdown_handler::handle_signal(int signal) {
+  int saved_errno = errno;
+  shutdown_requested = true;
+  auto byte = static_cast<unsigned char>(signal);
+  [[maybe_unused]] auto written = write(signal_pipe[1], &byte, 1);
+  errno = saved_errno;
+}
+
 void shutdown_handler::register_handler() {
-  std::signal(SIGINT, handle_signal);
-  std::signal(SIGTERM, handle_signal);
+  static_assert(std::atomic<bool>::is_always_lock_free, "The shutdown flag is set from a signal handler");
+
+  if (pipe(signal_pipe) != 0) {
+    logging::error("shutdown", "Could not create the signal pipe.");
+    return;
+  }
+  for (int fd : signal_pipe) {
+    // Close-on-exec keeps the pipe out of aria2; the write end must never block inside the handler
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+  }
+  fcntl(signal_pipe[1], F_SETFL, fcntl(signal_pipe[1], F_GETFL) | O_NONBLOCK);
+
+  // Blocks in read() for the rest of the process, so it is never joined
+  std::thread(watch_signals).detach();
+
+  struct sigaction action{};
+  action.sa_handler = handle_signal;
+  sigemptyset(&action.sa_mask);
+  action.sa_flags = SA_RESTART;
+  sigaction(SIGINT, &action, nullptr);
+  sigaction(SIGTERM, &action, nullptr);
 }
 #endif
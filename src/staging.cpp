@@ -0,0 +1,188 @@
+#include "staging.hpp"
+#include "logging.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <system_error>
+#include <utility>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+#ifdef __linux__
+// Copies (or clones) the contents between two open files within the kernel; nothing if neither way works here
+std::optional<staging::Method> copy_in_kernel(int source, int target) {
+  // Shares the extents outright on btrfs, XFS and the like
+  if (ioctl(target, FICLONE, source) == 0) {
+    return staging::Method::Reflink;
+  }
+
+  struct stat info{};
+  if (fstat(source, &info) != 0) {
+    return std::nullopt;
+  }
+  auto remaining = static_cast<size_t>(info.st_size);
+  while (remaining > 0) {
+    auto copied = copy_file_range(source, nullptr, target, nullptr, remaining, 0);
+    if (copied < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      // EXDEV/EINVAL/ENOSYS before anything was copied: let the portable copy take over
+      if (remaining == static_cast<size_t>(info.st_size) && (errno == EXDEV || errno == EINVAL || errno == ENOSYS || errno == EOPNOTSUPP)) {
+        return std::nullopt;
+      }
+      logging::error("staging", "copy_file_range failed: {}", std::strerror(errno));
+      return std::nullopt;
+    }
+    if (copied == 0) {
+      break;
+    }
+    remaining -= static_cast<size_t>(copied);
+  }
+  return remaining == 0 ? std::optional{staging::Method::CopyFileRange} : std::nullopt;
+}
+#endif
+
+std::optional<staging::Method> copy_contents(const fs::path& from, const fs::path& to) {
+#ifdef __linux__
+  int source = open(from.c_str(), O_RDONLY | O_CLOEXEC);
+  if (source >= 0) {
+    int target = open(to.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    std::optional<staging::Method> method;
+    if (target >= 0) {
+      method = copy_in_kernel(source, target);
+      close(target);
+    }
+    close(source);
+    if (method) {
+      return method;
+    }
+  }
+#endif
+  std::error_code error;
+  fs::copy_file(from, to, fs::copy_options::overwrite_existing, error);
+  if (error) {
+    logging::error("staging", "Could not copy {} to {}: {}", from.string(), to.string(), error.message());
+    return std::nullopt;
+  }
+  return staging::Method::Copy;
+}
+
+} // namespace
+
+const char* staging::method_name(Method method) {
+  switch (method) {
+  case Method::Rename:
+    return "rename";
+  case Method::Reflink:
+    return "reflink";
+  case Method::CopyFileRange:
+    return "copy_file_range";
+  default:
+    return "copy";
+  }
+}
+
+std::optional<staging::Method> staging::move_file(const fs::path& from, const fs::path& to) {
+  std::error_code error;
+  fs::create_directories(to.parent_path(), error);
+  fs::rename(from, to, error);
+  if (!error) {
+    return Method::Rename;
+  }
+  if (error != std::errc::cross_device_link) {
+    logging::error("staging", "Could not move {} to {}: {}", from.string(), to.string(), error.message());
+    return std::nullopt;
+  }
+
+  // Across filesystems, so the final name only ever appears complete
+  auto temp_path = to;
+  temp_path += ".part";
+  auto method = copy_contents(from, temp_path);
+  if (!method) {
+    fs::remove(temp_path, error);
+    return std::nullopt;
+  }
+  fs::last_write_time(temp_path, fs::last_write_time(from, error), error);
+  fs::rename(temp_path, to, error);
+  if (error) {
+    logging::error("staging", "Could not move {} into place: {}", temp_path.string(), error.message());
+    fs::remove(temp_path, error);
+    return std::nullopt;
+  }
+  fs::remove(from, error);
+  return method;
+}
+
+staging::Finalizer::Finalizer(size_t workers) : worker_count(std::max<size_t>(workers, 1)) {}
+
+staging::Finalizer::~Finalizer() {
+  {
+    std::lock_guard lock(mutex);
+    stopping = true;
+  }
+  job_ready.notify_all();
+  for (auto& worker : workers) {
+    worker.join();
+  }
+}
+
+void staging::Finalizer::submit(fs::path from, fs::path to) {
+  {
+    std::lock_guard lock(mutex);
+    jobs.emplace_back(std::move(from), std::move(to));
+    if (workers.size() < worker_count && workers.size() < jobs.size() + in_progress) {
+      workers.emplace_back(&Finalizer::run, this);
+    }
+  }
+  job_ready.notify_one();
+}
+
+staging::Finalizer::Totals staging::Finalizer::wait() {
+  std::unique_lock lock(mutex);
+  idle.wait(lock, [&] { return jobs.empty() && in_progress == 0; });
+  return std::exchange(totals, {});
+}
+
+void staging::Finalizer::run() {
+  std::unique_lock lock(mutex);
+  while (true) {
+    // Queued moves are finished before stopping, so no download is left behind in the staging directory
+    job_ready.wait(lock, [&] { return stopping || !jobs.empty(); });
+    if (jobs.empty()) {
+      return;
+    }
+    auto [from, to] = std::move(jobs.front());
+    jobs.pop_front();
+    ++in_progress;
+    lock.unlock();
+
+    auto method = move_file(from, to);
+    if (method) {
+      logging::debug("staging", "Moved {} ({})", to.string(), method_name(*method));
+    }
+
+    lock.lock();
+    --in_progress;
+    if (method) {
+      ++totals.moved;
+      totals.copied += *method != Method::Rename;
+    } else {
+      ++totals.failed;
+    }
+    if (jobs.empty() && in_progress == 0) {
+      idle.notify_all();
+    }
+  }
+}
@@ -0,0 +1,288 @@
+#include "stream.hpp"
+#include "async.hpp"
+#include "logging.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <format>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#ifndef _WIN32
+namespace {
+
+// Fixed set of chunk slots shared by the fetching event loop and the writer thread; chunk i lives in slot i % slots.
+// Releasing a slot (or giving up) wakes the loop, where fetches wait for room
+class RingBuffer {
+public:
+  RingBuffer(async::EventLoop& loop, size_t slots) : loop(loop), chunks(slots), filled(slots, SIZE_MAX) {}
+
+  size_t slots() const noexcept {
+    return chunks.size();
+  }
+
+  // Chunks below this index have been handed off, so their slots can take new data
+  size_t released() const noexcept {
+    return released_count;
+  }
+
+  bool stopped() const noexcept {
+    return failed;
+  }
+
+  void put(size_t index, std::string data) {
+    {
+      std::lock_guard lock(mutex);
+      chunks[index % chunks.size()] = std::move(data);
+      filled[index % chunks.size()] = index;
+    }
+    ready.notify_one();
+  }
+
+  // Waits for chunk `index`; nothing once either side gave up. The slot is left alone until it is released
+  const std::string* wait(size_t index) {
+    std::unique_lock lock(mutex);
+    ready.wait(lock, [&] { return failed || filled[index % chunks.size()] == index; });
+    return failed ? nullptr : &chunks[index % chunks.size()];
+  }
+
+  void release(size_t count) noexcept {
+    released_count = count;
+    loop.wake();
+  }
+
+  void fail() {
+    {
+      std::lock_guard lock(mutex);
+      failed = true;
+    }
+    ready.notify_all();
+    loop.wake();
+  }
+
+private:
+  async::EventLoop& loop;
+  std::vector<std::string> chunks;
+  std::vector<size_t> filled; // chunk index held by each slot
+  std::mutex mutex;
+  std::condition_variable ready;
+  std::atomic<size_t> released_count{0};
+  std::atomic<bool> failed{false};
+};
+
+struct Transfer {
+  const std::string& url;
+  const stream::Options& options;
+  std::uint64_t total_size;
+  size_t chunk_count;
+  size_t next_chunk{0};
+  RingBuffer ring;
+};
+
+// Size of the resource, if the server takes range requests for it
+async::Task<std::optional<std::uint64_t>> probe_size(async::EventLoop& loop, std::string url) {
+  async::HttpRequest request;
+  request.method = "HEAD";
+  request.decode_content = false;
+  request.url = std::move(url);
+  auto response = co_await loop.fetch(std::move(request));
+  if (response.status_code != 200 || !response.error.empty()) {
+    logging::error("stream", "HEAD request failed: {}", response.error.empty() ? std::to_string(response.status_code) : response.error);
+    co_return std::nullopt;
+  }
+  if (response.headers["accept-ranges"] != "bytes" || !response.headers.contains("content-length")) {
+    logging::error("stream", "Server does not support range requests.");
+    co_return std::nullopt;
+  }
+  co_return std::stoull(response.headers["content-length"]);
+}
+
+// Claims chunks in order and fetches each once its slot is free, retrying with a short backoff
+async::Task<void> fetch_chunks(async::EventLoop& loop, Transfer& transfer) {
+  while (!transfer.ring.stopped()) {
+    auto index = transfer.next_chunk++;
+    if (index >= transfer.chunk_count) {
+      co_return;
+    }
+    while (index >= transfer.ring.released() + transfer.ring.slots()) {
+      if (transfer.ring.stopped() || !co_await loop.woken()) {
+        transfer.ring.fail();
+        co_return;
+      }
+    }
+
+    auto first = index * transfer.options.chunk_size;
+    auto last = std::min(first + transfer.options.chunk_size, transfer.total_size) - 1;
+    bool fetched = false;
+    for (size_t attempt = 0; attempt <= transfer.options.max_retries && !fetched; ++attempt) {
+      if (attempt > 0 && !co_await loop.sleep_for(std::chrono::milliseconds(500) * attempt)) {
+        break;
+      }
+      async::HttpRequest request;
+      request.url = transfer.url;
+      request.headers.push_back(std::format("Range: bytes={}-{}", first, last));
+      request.timeout = std::chrono::minutes(2);
+      // A compressed reply would no longer be the exact byte range asked for
+      request.decode_content = false;
+      auto response = co_await loop.fetch(std::move(request));
+      if (response.cancelled) {
+        break;
+      }
+      if (response.status_code == 206 && response.text.size() == last - first + 1) {
+        transfer.ring.put(index, std::move(response.text));
+        fetched = true;
+      } else {
+        logging::warn("stream", "Range {}-{} failed ({}).", first, last,
+                      response.error.empty() ? std::to_string(response.status_code) : response.error);
+      }
+    }
+    if (!fetched) {
+      transfer.ring.fail();
+      co_return;
+    }
+  }
+}
+
+// vmsplice hands our pages to the pipe by reference, so a chunk must not be freed while the pipe may still hold it.
+// Once the whole next chunk has gone in after it, it cannot: a chunk is at least as large as the pipe. The last chunk has
+// no successor (and may be short), so the last two are copied in with write() and nothing is referenced once we return
+bool can_splice(int fd, std::uint64_t chunk_size) {
+#ifdef __linux__
+  struct stat info{};
+  if (fstat(fd, &info) != 0 || !S_ISFIFO(info.st_mode)) {
+    return false;
+  }
+  auto pipe_size = fcntl(fd, F_GETPIPE_SZ);
+  return pipe_size > 0 && chunk_size >= static_cast<std::uint64_t>(pipe_size);
+#else
+  return false;
+#endif
+}
+
+bool write_all(int fd, std::string_view data, bool splice) {
+  while (!data.empty()) {
+    ssize_t written;
+#ifdef __linux__
+    if (splice) {
+      iovec chunk{const_cast<char*>(data.data()), data.size()};
+      written = vmsplice(fd, &chunk, 1, 0);
+    } else {
+      written = write(fd, data.data(), data.size());
+    }
+#else
+    written = write(fd, data.data(), data.size());
+#endif
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      logging::error("stream", "Write failed: {}", std::strerror(errno));
+      return false;
+    }
+    data.remove_prefix(static_cast<size_t>(written));
+  }
+  return true;
+}
+
+} // namespace
+#endif
+
+std::optional<int> stream::open_output(const std::string& target) {
+#ifndef _WIN32
+  // A reader going away should end the stream with an error, not kill the process
+  std::signal(SIGPIPE, SIG_IGN);
+  if (target == "-") {
+    std::fflush(stdout);
+    int fd = dup(STDOUT_FILENO);
+    if (fd < 0) {
+      return std::nullopt;
+    }
+    dup2(STDERR_FILENO, STDOUT_FILENO);
+    return fd;
+  }
+
+  struct stat info{};
+  if (stat(target.c_str(), &info) != 0) {
+    if (mkfifo(target.c_str(), 0644) != 0) {
+      logging::error("stream", "Could not create FIFO {}: {}", target, std::strerror(errno));
+      return std::nullopt;
+    }
+    info.st_mode = S_IFIFO;
+  }
+  // An existing file is overwritten, so nothing of its old contents is left past the end of the stream
+  int flags = O_WRONLY | O_CLOEXEC | (S_ISREG(info.st_mode) ? O_TRUNC : 0);
+  if (S_ISFIFO(info.st_mode)) {
+    logging::info("stream", "Waiting for a reader on {}...", target);
+  }
+  int fd = open(target.c_str(), flags);
+  if (fd < 0) {
+    logging::error("stream", "Could not open {}: {}", target, std::strerror(errno));
+    return std::nullopt;
+  }
+  return fd;
+#else
+  logging::error("stream", "Streaming is not supported on Windows.");
+  return std::nullopt;
+#endif
+}
+
+std::optional<std::uint64_t> stream::pipe_url(const std::string& url, int fd, const Options& options) {
+#ifndef _WIN32
+  async::EventLoop loop;
+  auto total_size = loop.run(probe_size(loop, url));
+  if (!total_size) {
+    return std::nullopt;
+  }
+  if (*total_size == 0) {
+    return 0;
+  }
+
+  Transfer transfer{url, options, *total_size, static_cast<size_t>((*total_size + options.chunk_size - 1) / options.chunk_size), 0,
+                    RingBuffer{loop, std::max<size_t>(options.buffered_chunks, 2)}};
+  bool splice = can_splice(fd, options.chunk_size);
+
+  // The writer runs on its own thread, so a slow reader never stalls the transfers (and the other way round)
+  std::uint64_t written = 0;
+  std::thread writer([&] {
+    for (size_t index = 0; index < transfer.chunk_count; ++index) {
+      auto chunk = transfer.ring.wait(index);
+      bool by_reference = splice && index + 2 < transfer.chunk_count;
+      if (chunk == nullptr || !write_all(fd, *chunk, by_reference)) {
+        transfer.ring.fail();
+        return;
+      }
+      written += chunk->size();
+      transfer.ring.release(by_reference ? index : index + 1);
+    }
+  });
+
+  std::vector<async::Task<void>> workers;
+  for (size_t i = 0; i < std::clamp<size_t>(options.parallel, 1, transfer.ring.slots()); ++i) {
+    workers.push_back(fetch_chunks(loop, transfer));
+  }
+  loop.run(async::gather(std::move(workers)));
+  writer.join();
+
+  if (written != *total_size) {
+    return std::nullopt;
+  }
+  return written;
+#else
+  return std::nullopt;
+#endif
+}
@@ -1,28 +1,26 @@
 #include "util.hpp"
 #include "CLI11.hpp"
 #include "aria2_manager.hpp"
-#include "shutdown_handler.hpp"
-#include <chrono>
-#include <condition_variable>
+#include "logging.hpp"
+#include <algorithm>
 #include <cstdlib>
+#include <filesystem>
 #include <fstream>
-#include <iostream>
-#include <mutex>
+#include <ranges>
 #include <string>
 #include <vector>
 
-bool util::validate_magnet_link(const std::string& magnet) {
-  constexpr std::string_view prefix = "magnet:?xt=urn:btih:";
-  if (!magnet.starts_with(prefix))
-    return false;
-  auto hash = magnet.substr(prefix.size(), 40);      // hex length
-  return hash.length() == 40 || hash.length() == 32; // allow base32
-}
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 void util::load_env_file(const std::string& path) {
   std::ifstream file(path);
   if (!file) {
-    std::cerr << "[INFO] No .env file found, skipping...\n";
+    logging::debug("env", "No .env file found, skipping...");
     return;
   }
 
@@ -48,7 +46,24 @@ void util::load_env_file(const std::string& path) {
   }
 }
 
-std::string util::get_rd_token(std::string& cli_token) {
+namespace {
+
+std::vector<std::string> split_tokens(std::string_view list) {
+  std::vector<std::string> tokens;
+  for (auto part : list | std::views::split(',')) {
+    std::string_view token{part.begin(), part.end()};
+    token.remove_prefix(std::min(token.find_first_not_of(' '), token.size()));
+    token = token.substr(0, token.find_last_not_of(' ') + 1);
+    if (!token.empty()) {
+      tokens.emplace_back(token);
+    }
+  }
+  return tokens;
+}
+
+} // namespace
+
+std::vector<std::string> util::get_rd_tokens(const std::string& cli_token) {
   // 1. CLI token provided
   if (!cli_token.empty()) {
     std::ofstream env_file(".env", std::ios::trunc);
@@ -57,82 +72,106 @@ std::string util::get_rd_token(std::string& cli_token) {
     }
     env_file << "REAL_DEBRID_API_TOKEN=" << cli_token << "\n";
     env_file.close();
-    std::cerr << "API token saved to .env\n";
-    return cli_token;
+    logging::info("env", "API token saved to .env");
+    return split_tokens(cli_token);
   }
   load_env_file(".env");
   // 2. Check environment variable
-  if (const char* env_token = std::getenv("REAL_DEBRID_API_TOKEN")) {
-    return std::string{env_token};
+  if (const char* env_token = std::getenv("REAL_DEBRID_API_TOKEN"); env_token != nullptr && !split_tokens(env_token).empty()) {
+    return split_tokens(env_token);
   } else {
     fatal_exit("No API token found; Run with -t <token> or set REAL_DEBRID_API_TOKEN environment variable.");
   }
 }
 
-std::tuple<std::string, std::string, bool, std::string, bool> util::parse_arguments(int argc, char* argv[]) {
+util::Arguments util::parse_arguments(int argc, char* argv[]) {
   CLI::App app{"Real-Debrid → Aria2 helper"};
 
-  std::string api_token{};
-  std::string magnet{};
-  bool links_flag = false;
-  bool aria2_flag = false;
-  std::string output_folder{};
+  Arguments arguments;
 
-  app.add_option("-t,--token", api_token, "Set API token and save it locally");
-  app.add_option("-m,--magnet", magnet, "Magnet link")->required();
-  app.add_flag("-l,--links", links_flag, "Print unrestricted links");
-  app.add_option("-o,--output", output_folder, "Specify path for output .txt file");
-  app.add_flag("-a,--aria2", aria2_flag, "Start download using aria2");
+  app.add_option("-t,--token", arguments.api_token, "Set API token(s) and save them locally; separate several accounts with commas");
+  app.add_option("-m,--magnet", arguments.magnet, "Magnet link");
+  app.add_option("-f,--magnet-file", arguments.magnet_file, "File with one magnet link per line")->check(CLI::ExistingFile);
+  app.add_option("--hoster-links", arguments.hoster_file, "File with one hoster link per line; dead links are weeded out first")
+      ->check(CLI::ExistingFile);
+  auto* links_option = app.add_flag("-l,--links", arguments.links_flag, "Print unrestricted links");
+  auto* output_option = app.add_option("-o,--output", arguments.output_path, "Specify path for output links file");
+  app.add_option("--format", arguments.format, "Links file format: plain, aria2, metalink or jsonl")
+      ->check(CLI::IsMember({"plain", "aria2", "metalink", "jsonl"}));
+  auto* aria2_option = app.add_flag("-a,--aria2", arguments.aria2_flag, "Start download using aria2");
+  app.add_flag("--lazy", arguments.lazy_flag, "Unrestrict links only shortly before aria2 starts them, renewing links that fail")
+      ->needs(aria2_option)
+      ->excludes(links_option, output_option);
+  app.add_flag("--fixed", arguments.fixed_flag, "Keep aria2's concurrency and connection counts as derived, without adapting them")
+      ->needs(aria2_option);
+  app.add_option("--staging", arguments.staging_dir, "Download into this (fast) directory first, moving finished files to ./Downloads")
+      ->needs(aria2_option);
+  app.add_option("--stream", arguments.stream_target, "Stream the files in order to stdout, or to the given FIFO, instead of saving them")
+      ->expected(0, 1)
+      ->default_str("-")
+      ->excludes(aria2_option);
+  app.add_flag("-r,--resume", arguments.resume_flag, "Resume downloads paused by an interrupted run (implies -a)");
+  app.add_option("--log-level", arguments.log_level, "Least severe diagnostics to show: debug, info, warn, error or off")
+      ->check(CLI::IsMember({"debug", "info", "warn", "error", "off"}));
+  app.add_option("--log-format", arguments.log_format, "Diagnostics as human readable lines or JSON Lines: human or json")
+      ->check(CLI::IsMember({"human", "json"}));
+  app.add_flag("--sync", arguments.sync_flag, "Mirror the account's torrents and downloads into a local library");
+  auto* search_option = app.add_option("-s,--search", arguments.search, "Search the local library by name, hash or id (empty matches all)");
+  app.add_option("--status", arguments.status, "Only list library entries with this status")->needs(search_option);
+  app.add_option("--since", arguments.since, "Only list library entries added on or after this date (YYYY-MM-DD)")->needs(search_option);
+  app.add_option("--limit", arguments.search_limit, "Maximum number of search results")->needs(search_option);
 
   try {
     app.parse(argc, argv);
+    bool has_input = !arguments.magnet.empty() || !arguments.magnet_file.empty() || !arguments.hoster_file.empty();
+    if (!has_input && !arguments.resume_flag && !arguments.sync_flag && !arguments.search) {
+      throw CLI::RequiredError("--magnet, --magnet-file, --hoster-links, --resume, --sync or --search");
+    }
+    arguments.aria2_flag = arguments.aria2_flag || arguments.resume_flag;
   } catch (const CLI::ParseError& e) {
     std::exit(app.exit(e));
   }
 
-  return {api_token, magnet, links_flag, output_folder, aria2_flag};
-}
-
-util::TokenBucket::TokenBucket(size_t capacity, double refill_rate_per_sec)
-    : capacity(capacity), tokens(capacity), refill_rate(refill_rate_per_sec), last_refill(std::chrono::steady_clock::now()) {
-  refill_thread = std::thread([this]() {
-    while (!stop_flag) {
-      std::this_thread::sleep_for(std::chrono::milliseconds(100));
-      refill();
-    }
-  });
+  return arguments;
 }
 
-util::TokenBucket::~TokenBucket() {
-  {
-    std::lock_guard<std::mutex> lock(bucket_mtx);
-    stop_flag = true;
+util::MappedFile::MappedFile(const std::string& path) {
+#ifndef _WIN32
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return;
   }
-  cv.notify_all();
-  if (refill_thread.joinable()) {
-    refill_thread.join();
+  struct stat file_stat;
+  if (::fstat(fd, &file_stat) == 0) {
+    length = static_cast<size_t>(file_stat.st_size);
+    if (length == 0) {
+      open = true;
+    } else if (void* mapping = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0); mapping != MAP_FAILED) {
+      ::madvise(mapping, length, MADV_SEQUENTIAL);
+      data = static_cast<const char*>(mapping);
+      open = true;
+    } else {
+      length = 0;
+    }
   }
-}
-
-void util::TokenBucket::consume() {
-  std::unique_lock<std::mutex> lock(bucket_mtx);
-  cv.wait(lock, [this] { return tokens > 0 || stop_flag; });
-  if (stop_flag) {
-    return;
+  ::close(fd); // the mapping stays valid
+#else
+  std::ifstream file(path, std::ios::binary);
+  if (file) {
+    contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    data = contents.data();
+    length = contents.size();
+    open = true;
   }
-  --tokens;
+#endif
 }
 
-void util::TokenBucket::refill() {
-  auto time_now = std::chrono::steady_clock::now();
-  double seconds_passed = std::chrono::duration<double>(time_now - last_refill).count();
-  size_t new_tokens = static_cast<size_t>(seconds_passed * refill_rate);
-  if (new_tokens > 0) {
-    std::lock_guard<std::mutex> lock(bucket_mtx);
-    tokens = std::min(capacity, tokens + new_tokens);
-    last_refill = time_now;
-    cv.notify_all();
+util::MappedFile::~MappedFile() {
+#ifndef _WIN32
+  if (data != nullptr) {
+    ::munmap(const_cast<char*>(data), length);
   }
+#endif
 }
 
 util::File::File(std::string path) : path(std::move(path)), active(true) {}
@@ -140,7 +179,7 @@ util::File::File(std::string path) : path(std::move(path)), active(true) {}
 util::File::~File() {
   if (active) {
     if (path != "/tmp/" && std::remove(path.c_str()) != 0) {
-      std::cerr << "Temp file " << path << " could not be removed.\n";
+      logging::warn("util", "Temp file {} could not be removed.", path);
     }
   }
 }
@@ -149,55 +188,75 @@ void util::File::keep_file() {
   active = false;
 }
 
-void util::File::append_file_name_to_path(std::string& file_name, std::string& custom_path) {
+void util::File::append_file_name_to_path(const std::string& file_name, const std::string& custom_path, std::string_view suffix) {
   if (custom_path.empty()) {
-    path += file_name + "_links.txt";
+    path += file_name;
+    path += suffix;
   } else {
     keep_file();
-    path = std::move(custom_path);
+    path = custom_path;
     if (path.back() != '/') {
       path += '/';
     }
-    path += file_name + "_links.txt";
-    std::println("\nOutput file: {}", path);
+    path += file_name;
+    path += suffix;
+    logging::info("util", "Output file: {}", path);
   }
 }
 
-bool util::File::create_text_file(const std::vector<std::string>& links) {
-  // Open file in truncate mode
-  std::ofstream file(path, std::ios::trunc);
+bool util::File::create_text_file(std::string_view contents) {
+  return write_file_atomically(path, contents);
+}
 
-  if (!file.is_open()) {
-    std::cerr << "Error: Could not open file!\n";
-    return false;
+bool util::write_file_atomically(const std::string& path, std::string_view contents) {
+  auto temp_path = path + ".tmp";
+  {
+    std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+    if (!file.write(contents.data(), static_cast<std::streamsize>(contents.size())) || !file.flush()) {
+      logging::error("util", "Could not write {}", temp_path);
+      return false;
+    }
   }
-
-  // Append links
-  for (const auto& link : links) {
-    file << link << '\n';
+  std::error_code error;
+  std::filesystem::rename(temp_path, path, error);
+  if (error) {
+    logging::error("util", "Could not move {} into place: {}", temp_path, error.message());
+    std::filesystem::remove(temp_path, error);
+    return false;
   }
-
-  file.close();
   return true;
 }
 
-util::FileDownloadProgress::FileDownloadProgress(const std::string& link, const std::string& name)
-    : gid{}, name(std::move(name)), progress{0.0f}, completion_status(false) {
-  gid = aria2::rpc_add_download(link);
+util::FileDownloadProgress::FileDownloadProgress(const std::string& link, const std::string& name, const nlohmann::json& options)
+    : gid{}, link(link), name(name), options(options), progress{0.0f}, completion_status(false) {
+  gid = aria2::rpc_add_download(link, options);
   if (!gid) {
-    util::fatal_error("[aria2] Could not start download.\n");
+    util::fatal_error("Could not start aria2 download.");
   }
 }
 
-util::FileDownloadProgress::~FileDownloadProgress() {
-  if (shutdown_handler::shutdown_requested && !completion_status) {
-    try {
-      aria2::rpc_remove_download(gid.value());
-      // std::println("[aria2] Successfully stopped download {}.", name);
-    } catch (const std::exception& e) {
-      std::cerr << "[aria2] Could not remove the ongoing download: " << name << "\n";
-    }
+util::FileDownloadProgress util::FileDownloadProgress::adopt(std::string gid, std::string link, std::string name, nlohmann::json options) {
+  FileDownloadProgress file;
+  file.gid = std::move(gid);
+  file.link = std::move(link);
+  file.name = std::move(name);
+  file.options = std::move(options);
+  return file;
+}
+
+bool util::FileDownloadProgress::restart(const std::string& link) {
+  aria2::rpc_remove_download_result(gid.value());
+  auto resume_options = options;
+  resume_options["continue"] = "true";
+  auto new_gid = aria2::rpc_add_download(link, resume_options);
+  if (!new_gid) {
+    return false;
   }
+  gid = std::move(new_gid);
+  this->link = link;
+  progress = 0.0f;
+  ++restarts;
+  return true;
 }
 
 void util::print_progress_bar(const std::vector<util::FileDownloadProgress>& files, size_t max_length, size_t bar_width) {